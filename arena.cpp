@@ -0,0 +1,138 @@
+/*
+ * Level arena, see arena.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "arena.h"
+
+struct arena_block
+{
+   arena_block *next;
+   size_t size;   /* bytes after the header */
+   size_t used;
+   size_t pad;   /* keeps what follows 16 byte aligned */
+};
+
+static arena_block *blocks = NULL;   /* in the order they are used */
+static arena_block *current = NULL;
+
+long level_allocs = 0;
+size_t level_bytes = 0;
+long arena_mallocs = 0;
+size_t arena_held = 0;
+
+   /* for print_arena_stats */
+static size_t level_peak = 0;
+static long level_peak_allocs = 0;
+
+static arena_block *new_block(size_t size)
+{
+   arena_block *block = (arena_block *) malloc(sizeof(arena_block) + size);
+
+   if (block==NULL){
+      printf("\nout of memory for a %lu KB level block\n", (unsigned long)(size/1024));
+      exit(1);
+   }
+
+   block->next = NULL;
+   block->size = size;
+   block->used = 0;
+
+   arena_mallocs++;
+   arena_held += size;
+
+   return block;
+}
+
+void *level_alloc(size_t size)
+{
+   size = (size+15) & ~(size_t)15;
+
+      /* on into the blocks left from earlier levels before asking for one */
+   while (current!=NULL && current->used+size > current->size && current->next!=NULL)
+      current = current->next;
+
+   if (current==NULL || current->used+size > current->size){
+      arena_block *block = new_block(std::max(size, (size_t)ARENA_BLOCK));
+
+      if (current==NULL)
+         blocks = block;
+      else
+         current->next = block;
+      current = block;
+   }
+
+   void *mem = (char *)(current+1) + current->used;
+   current->used += size;
+
+   level_allocs++;
+   level_bytes += size;
+
+   memset(mem, 0, size);
+   return mem;
+}
+
+void *level_grow(void *old, size_t old_size, size_t new_size)
+{
+   void *mem = level_alloc(new_size);
+
+   if (old!=NULL)
+      memcpy(mem, old, old_size);
+
+   return mem;
+}
+
+void level_reset()
+{
+   if (level_bytes>level_peak){
+      level_peak = level_bytes;
+      level_peak_allocs = level_allocs;
+   }
+
+   size_t total = 0;
+
+   for (arena_block *block=blocks; block!=NULL; block=block->next)
+      total += block->used;
+   total = std::max(total, (size_t)ARENA_BLOCK);
+
+      /* one block the size of everything used, for next time. a huge level
+         does not get to keep its memory for the small ones after it */
+   if (blocks!=NULL && (blocks->next!=NULL || blocks->size>4*total)){
+      free_level_arena();
+      blocks = current = new_block(total);
+   }
+
+   for (arena_block *block=blocks; block!=NULL; block=block->next)
+      block->used = 0;
+   current = blocks;
+
+   level_allocs = 0;
+   level_bytes = 0;
+}
+
+void free_level_arena()
+{
+   while (blocks!=NULL){
+      arena_block *next = blocks->next;
+      arena_held -= blocks->size;
+      free(blocks);
+      blocks = next;
+   }
+
+   current = NULL;
+}
+
+void print_arena_stats()
+{
+   if (level_bytes>level_peak){
+      level_peak = level_bytes;
+      level_peak_allocs = level_allocs;
+   }
+
+   printf("arena: %ld blocks from malloc, %lu KB held, biggest level %lu KB in %ld allocations\n",
+      arena_mallocs, (unsigned long)(arena_held/1024), (unsigned long)(level_peak/1024), level_peak_allocs);
+}
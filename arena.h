@@ -0,0 +1,36 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/*
+ *  Memory that lives as long as a level.
+ *
+ *  Everything a level needs (the field, entities, batches, AI, rewind and
+ *  search tables) comes from level_alloc(), and level_reset() in cleanuplvl()
+ *  gives it all back at once. The blocks are kept for the next level. If a
+ *  level needed more than one, they are swapped for a single block as big
+ *  as all of them, so loading the same levels over and over settles on one
+ *  block and stops calling malloc at all. A block more than four times what
+ *  the level used is swapped for a smaller one the same way.
+ *
+ *  Not for anything freed on its own during a level, like streamed chunks,
+ *  and only used by whoever owns the level: the simulation thread, or the
+ *  main thread while that is stopped.
+ */
+
+   /* smallest block asked of malloc */
+#define ARENA_BLOCK (1<<20)
+
+extern long level_allocs;   /* level_alloc calls this level */
+extern size_t level_bytes;   /* bytes handed out this level */
+extern long arena_mallocs;   /* blocks ever taken from malloc */
+extern size_t arena_held;   /* bytes in blocks right now */
+
+void *level_alloc(size_t size);   /* zeroed, 16 byte aligned, until level_reset */
+void *level_grow(void *old, size_t old_size, size_t new_size);   /* a bigger copy of old, which is just left behind */
+void level_reset();   /* everything level_alloc gave out is gone */
+void free_level_arena();
+void print_arena_stats();
+
+#endif
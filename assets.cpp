@@ -0,0 +1,465 @@
+/*
+ * Asset pack, see assets.h.
+ *
+ *   A pack is a header, the data of every asset and a directory of them at
+ *   the end. Images are rows of 32 bit 0RGB pixels, glyphs a byte a pixel,
+ *   1 where the character is drawn. Data starts 16 byte aligned.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+#include "assets.h"
+
+#define ASSET_MAGIC "PMASSET1"
+
+#define ASSET_IMAGE 1
+#define ASSET_GLYPH 2
+
+#define FIRST_GLYPH 32
+#define LAST_GLYPH 126
+
+   /* 0RGB, the usual 32 bit display format */
+#define ASSET_RMASK 0x00FF0000
+#define ASSET_GMASK 0x0000FF00
+#define ASSET_BMASK 0x000000FF
+
+struct asset_header
+{
+   char magic[8];
+
+   int32_t count;
+   int32_t unused;
+      /* file offset of the count asset_entrys */
+   uint64_t dir_offset;
+};
+
+struct asset_entry
+{
+   char name[32];   /* file name without its directory, or "glyph <char>" */
+   int32_t kind;
+   int32_t w;
+   int32_t h;
+   int32_t unused;
+   uint64_t offset;
+};
+
+static char *asset_map = NULL;
+static size_t asset_map_size = 0;
+static asset_entry *entries = NULL;
+static int entry_count = 0;
+static asset_entry *glyphs[LAST_GLYPH+1];
+
+   /* only opened without a pack */
+static TTF_Font *font = NULL;
+
+const char *data_path(const char *path)
+{
+   static char paths[4][PATH_MAX];
+   static int next = 0;
+   char exe[PATH_MAX];
+
+   if (path[0]=='/' || access(path, F_OK)==0)
+      return path;
+
+   ssize_t n = readlink("/proc/self/exe", exe, sizeof(exe)-1);
+   if (n<=0)
+      return path;
+   exe[n] = '\0';
+
+   char *slash = strrchr(exe, '/');
+   if (slash==NULL)
+      return path;
+   *slash = '\0';
+
+   char *beside = paths[next++ % 4];
+   if (snprintf(beside, PATH_MAX, "%s/%s", exe, path)>=PATH_MAX)
+      return path;
+
+   return access(beside, F_OK)==0 ? beside : path;
+}
+
+/* writing a pack */
+
+static bool put_asset(FILE *out, asset_entry *entry, const void *data, size_t size)
+{
+   static const char zeros[16] = { 0 };
+   long at = ftell(out);
+   size_t pad = (16 - at%16) % 16;
+
+   if (at<0 || fwrite(zeros, 1, pad, out)!=pad || fwrite(data, 1, size, out)!=size)
+      return false;
+
+   entry->offset = at+pad;
+   return true;
+}
+
+static SDL_Surface *to_pixels(SDL_Surface *image)
+{
+   SDL_Surface *pixels = SDL_CreateRGBSurface(SDL_SWSURFACE, image->w, image->h, 32, ASSET_RMASK, ASSET_GMASK, ASSET_BMASK, 0);
+
+   if (pixels==NULL)
+      return NULL;
+
+      /* copied as they are, nothing keyed out or blended */
+   SDL_SetAlpha(image, 0, 0);
+   SDL_SetColorKey(image, 0, 0);
+   SDL_BlitSurface(image, NULL, pixels, NULL);
+
+   return pixels;
+}
+
+static bool pack_image(FILE *out, asset_entry *entry, const char *dir, const char *name)
+{
+   char path[PATH_MAX];
+
+   snprintf(path, PATH_MAX, "%s/%s", dir, name);
+
+   SDL_Surface *image = IMG_Load(path);
+   SDL_Surface *pixels = image ? to_pixels(image) : NULL;
+   bool ok = pixels!=NULL;
+
+   if (ok){
+      char *rows = (char *) malloc((size_t)pixels->w*pixels->h*4);
+
+      ok = rows!=NULL;
+      for (int y=0; ok && y<pixels->h; y++)
+         memcpy(rows + (size_t)y*pixels->w*4, (char *)pixels->pixels + y*pixels->pitch, pixels->w*4);
+
+      ok = ok && snprintf(entry->name, 32, "%s", name)<32;
+      entry->kind = ASSET_IMAGE;
+      entry->w = pixels->w;
+      entry->h = pixels->h;
+      ok = ok && put_asset(out, entry, rows, (size_t)pixels->w*pixels->h*4);
+
+      free(rows);
+   }
+
+   if (!ok)
+      printf("\ncould not pack %s\n", path);
+
+   SDL_FreeSurface(image);
+   SDL_FreeSurface(pixels);
+
+   return ok;
+}
+
+static bool pack_glyph(FILE *out, asset_entry *entry, TTF_Font *font, int c)
+{
+   char text[2] = { (char)c, '\0' };
+   SDL_Color white = { 255, 255, 255 };
+   SDL_Surface *glyph = TTF_RenderText_Solid(font, text, white);
+
+   if (glyph==NULL)
+      return false;
+
+      /* onto magenta, whatever is not magenta after is the character */
+   SDL_Surface *pixels = SDL_CreateRGBSurface(SDL_SWSURFACE, glyph->w, glyph->h, 32, ASSET_RMASK, ASSET_GMASK, ASSET_BMASK, 0);
+   unsigned char *mask = (unsigned char *) malloc((size_t)glyph->w*glyph->h);
+   bool ok = pixels!=NULL && mask!=NULL;
+
+   if (ok){
+      SDL_FillRect(pixels, NULL, ASSET_RMASK|ASSET_BMASK);
+      SDL_BlitSurface(glyph, NULL, pixels, NULL);
+
+      for (int y=0; y<pixels->h; y++)
+         for (int x=0; x<pixels->w; x++)
+            mask[y*pixels->w + x] = ((Uint32 *)((char *)pixels->pixels + y*pixels->pitch))[x] != (ASSET_RMASK|ASSET_BMASK);
+
+      snprintf(entry->name, 32, "glyph %d", c);
+      entry->kind = ASSET_GLYPH;
+      entry->w = glyph->w;
+      entry->h = glyph->h;
+      ok = put_asset(out, entry, mask, (size_t)glyph->w*glyph->h);
+   }
+
+   free(mask);
+   SDL_FreeSurface(pixels);
+   SDL_FreeSurface(glyph);
+
+   return ok;
+}
+
+int pack_assets(const char *out_file)
+{
+   const char *dir = data_path("assets");
+   asset_entry list[256];
+   asset_header header;
+   int count = 0;
+   bool ok = true;
+
+   if (!TTF_WasInit() && TTF_Init()==-1){
+      printf("\nSDL_ttf did not start\n");
+      return 0;
+   }
+
+   TTF_Font *pack_font = TTF_OpenFont(data_path("assets/arial.ttf"), ASSET_FONT_SIZE);
+   DIR *images = opendir(dir);
+   FILE *out = fopen(out_file, "wb");
+
+   if (pack_font==NULL || images==NULL || out==NULL){
+      printf("\ncould not read %s/arial.ttf and %s, or write %s\n", dir, dir, out_file);
+      ok = false;
+   }
+
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, ASSET_MAGIC, 8);
+   memset(list, 0, sizeof(list));
+
+      /* header goes in last, once the directory is written */
+   ok = ok && fwrite(&header, sizeof(header), 1, out)==1;
+
+   for (struct dirent *file; ok && (file = readdir(images))!=NULL; )
+   {
+      size_t len = strlen(file->d_name);
+
+      if (len<4 || len>=32 || strcmp(file->d_name+len-4, ".png")!=0)
+         continue;
+
+      if (count==256-(LAST_GLYPH-FIRST_GLYPH+1)){
+         printf("\ntoo many images in %s\n", dir);
+         ok = false;
+         break;
+      }
+      ok = pack_image(out, &list[count++], dir, file->d_name);
+   }
+
+   for (int c=FIRST_GLYPH; ok && c<=LAST_GLYPH; c++)
+      ok = pack_glyph(out, &list[count++], pack_font, c);
+
+   asset_entry directory = { { 0 } };
+
+      /* the directory is aligned like the data */
+   ok = ok && put_asset(out, &directory, list, count*sizeof(asset_entry));
+
+   header.count = count;
+   header.dir_offset = directory.offset;
+
+   ok = ok && fseek(out, 0, SEEK_SET)==0 && fwrite(&header, sizeof(header), 1, out)==1;
+
+   if (out!=NULL)
+      fclose(out);
+   if (images!=NULL)
+      closedir(images);
+   if (pack_font!=NULL)
+      TTF_CloseFont(pack_font);
+
+   if (ok)
+      printf("packed %d images and %d glyphs into %s\n", count-(LAST_GLYPH-FIRST_GLYPH+1), LAST_GLYPH-FIRST_GLYPH+1, out_file);
+   else
+      unlink(out_file);
+
+   return ok;
+}
+
+/* reading one */
+
+   /* newest change to assets/ or a file in it, 0 if it is not there */
+static time_t assets_changed()
+{
+   const char *dir = data_path("assets");
+   DIR *files = opendir(dir);
+   struct stat st;
+   time_t newest = 0;
+
+   if (files==NULL)
+      return 0;
+
+   if (stat(dir, &st)==0)
+      newest = st.st_mtime;
+
+   for (struct dirent *file; (file = readdir(files))!=NULL; )
+   {
+      char path[PATH_MAX];
+
+      if (snprintf(path, PATH_MAX, "%s/%s", dir, file->d_name)<PATH_MAX && stat(path, &st)==0)
+         newest = std::max(newest, st.st_mtime);
+   }
+
+   closedir(files);
+   return newest;
+}
+
+bool open_assets()
+{
+   asset_header header;
+   struct stat st;
+   int fd = open(data_path(ASSET_PACK), O_RDONLY);
+
+   if (fd==-1)
+      return false;
+
+   if (fstat(fd, &st)==-1 || (size_t)st.st_size<sizeof(header)){
+      close(fd);
+      return false;
+   }
+
+      /* an image changed since the pack was made, so the pack is out of date */
+   if (assets_changed()>st.st_mtime){
+      printf("\n%s is older than assets/, loading the images instead. 'Packman assets' makes a new one\n", data_path(ASSET_PACK));
+      close(fd);
+      return false;
+   }
+
+      /* private and writable, surfaces on top of it are never written to the file */
+   asset_map = (char *) mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+   close(fd);
+
+   if (asset_map==MAP_FAILED){
+      asset_map = NULL;
+      return false;
+   }
+   asset_map_size = st.st_size;
+
+   memcpy(&header, asset_map, sizeof(header));
+
+   if (memcmp(header.magic, ASSET_MAGIC, 8)!=0 || header.count<0 || header.dir_offset%16!=0
+      || header.dir_offset+(uint64_t)header.count*sizeof(asset_entry)>asset_map_size){
+      printf("\nbad asset pack %s, not using it\n", data_path(ASSET_PACK));
+      close_assets();
+      return false;
+   }
+
+   entries = (asset_entry *) (asset_map + header.dir_offset);
+   entry_count = header.count;
+
+   for (int i=0; i<entry_count; i++)
+   {
+      asset_entry *entry = &entries[i];
+      uint64_t bytes = (uint64_t)entry->w*entry->h*(entry->kind==ASSET_IMAGE ? 4 : 1);
+      int c;
+
+      if (entry->w<0 || entry->h<0 || entry->offset+bytes>asset_map_size){
+         printf("\nbad asset %.31s in the pack, not using it\n", entry->name);
+         close_assets();
+         return false;
+      }
+
+      if (entry->kind==ASSET_GLYPH && sscanf(entry->name, "glyph %d", &c)==1 && c>=FIRST_GLYPH && c<=LAST_GLYPH)
+         glyphs[c] = entry;
+   }
+
+   return true;
+}
+
+SDL_Surface *asset_image(const char *file)
+{
+   const char *slash = strrchr(file, '/');
+   const char *name = slash ? slash+1 : file;
+
+   for (int i=0; i<entry_count; i++)
+   {
+      asset_entry *entry = &entries[i];
+
+      if (entry->kind!=ASSET_IMAGE || strncmp(entry->name, name, 32)!=0)
+         continue;
+
+      SDL_Surface *image = SDL_CreateRGBSurfaceFrom(asset_map+entry->offset, entry->w, entry->h, 32, entry->w*4,
+         ASSET_RMASK, ASSET_GMASK, ASSET_BMASK, 0);
+      SDL_Surface *screen = SDL_GetVideoSurface();
+
+         /* a copy only if the screen is not 0RGB itself */
+      if (image!=NULL && screen!=NULL && (screen->format->BitsPerPixel!=32 || screen->format->Rmask!=ASSET_RMASK
+         || screen->format->Gmask!=ASSET_GMASK || screen->format->Bmask!=ASSET_BMASK)){
+         SDL_Surface *converted = SDL_DisplayFormat(image);
+         SDL_FreeSurface(image);
+         image = converted;
+      }
+
+      if (image!=NULL)
+         SDL_SetColorKey(image, SDL_SRCCOLORKEY, SDL_MapRGB(image->format, 0, 0xFF, 0xFF));
+
+      return image;
+   }
+
+   return NULL;
+}
+
+SDL_Surface *render_text(const char *text, SDL_Color color)
+{
+   if (entry_count==0){
+      if (font==NULL && (TTF_WasInit() || TTF_Init()!=-1))
+         font = TTF_OpenFont(data_path("assets/arial.ttf"), ASSET_FONT_SIZE);
+
+      return font ? TTF_RenderText_Solid(font, text, color) : NULL;
+   }
+
+   int w = 0, h = 1;
+
+   for (const char *c=text; *c; c++)
+   {
+      asset_entry *glyph = glyphs[(unsigned char)*c<=LAST_GLYPH ? (unsigned char)*c : '?'];
+
+      if (glyph==NULL)
+         glyph = glyphs[' '];
+      if (glyph!=NULL){
+         w += glyph->w;
+         h = std::max(h, (int)glyph->h);
+      }
+   }
+
+   SDL_Surface *line = SDL_CreateRGBSurface(SDL_SWSURFACE, std::max(w,1), h, 32, ASSET_RMASK, ASSET_GMASK, ASSET_BMASK, 0);
+
+   if (line==NULL)
+      return NULL;
+
+      /* magenta behind, color can be anything else */
+   Uint32 key = ASSET_RMASK|ASSET_BMASK;
+   Uint32 ink = SDL_MapRGB(line->format, color.r, color.g, color.b);
+
+   SDL_FillRect(line, NULL, key);
+   SDL_SetColorKey(line, SDL_SRCCOLORKEY, key);
+
+   int at = 0;
+
+   for (const char *c=text; *c; c++)
+   {
+      asset_entry *glyph = glyphs[(unsigned char)*c<=LAST_GLYPH ? (unsigned char)*c : '?'];
+
+      if (glyph==NULL)
+         glyph = glyphs[' '];
+      if (glyph==NULL)
+         continue;
+
+      const unsigned char *mask = (const unsigned char *) asset_map + glyph->offset;
+
+      for (int y=0; y<glyph->h; y++)
+      {
+         Uint32 *row = (Uint32 *) ((char *)line->pixels + y*line->pitch) + at;
+
+         for (int x=0; x<glyph->w; x++)
+            if (mask[y*glyph->w + x])
+               row[x] = ink;
+      }
+
+      at += glyph->w;
+   }
+
+   return line;
+}
+
+void close_assets()
+{
+   if (asset_map!=NULL)
+      munmap(asset_map, asset_map_size);
+
+   asset_map = NULL;
+   asset_map_size = 0;
+   entries = NULL;
+   entry_count = 0;
+   memset(glyphs, 0, sizeof(glyphs));
+
+   if (font!=NULL)
+      TTF_CloseFont(font);
+   font = NULL;
+
+   if (TTF_WasInit())
+      TTF_Quit();
+}
@@ -0,0 +1,32 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#include "boilerplate.h"
+
+/*
+ *  Images and text without decoding anything at startup.
+ *
+ *  'Packman assets' (or 'make assets') decodes every PNG in assets/ to 32 bit
+ *  pixels and draws every printable character of the font once, and writes
+ *  it all to one pack file, ASSET_PACK. The game maps the pack and
+ *  load_image() hands out surfaces straight on top of the mapping; text is
+ *  put together from the glyphs. Without a pack, or with one older than
+ *  something in assets/, everything is loaded the old way, and SDL_ttf only
+ *  starts if text is needed then.
+ *
+ *  The pack, levels and assets are looked for in the current directory and
+ *  then next to the executable, so the game starts from anywhere.
+ */
+
+#define ASSET_PACK "packman.assets"
+   /* the font size everything is drawn in */
+#define ASSET_FONT_SIZE 18
+
+const char *data_path(const char *path);   /* path, or the same beside the executable if it is not here */
+int pack_assets(const char *out_file);   /* decode assets/ into a pack, returns 1 on success */
+bool open_assets();   /* map the pack if there is one, returns whether there is */
+SDL_Surface *asset_image(const char *file);   /* the image with file's name from the pack, NULL if not in it */
+SDL_Surface *render_text(const char *text, SDL_Color color);   /* a line of text, cyan where there is none */
+void close_assets();
+
+#endif
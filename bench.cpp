@@ -0,0 +1,340 @@
+/*
+ * Benchmarks, run with 'Packman bench'.
+ *
+ *   Times flood_distances over generated mazes from 20x20 up to 4096x4096,
+ *   and drawing the background and pellets with the camera on the player,
+ *   once with the direct blitter and once through SDL_BlitSurface. The tile
+ *   layout is picked at compile time, so 'make bench' builds and runs one
+ *   binary per layout to compare them.
+ *
+ *   Then whole game ticks on mazes with one enemy per 400 tiles, to see what
+ *   the AI scheduler keeps a tick at, and on a grid of junctions crowded with
+ *   enemies around the player, all getting to a junction in the same tick,
+ *   to see it spread more decisions than AI_BUDGET over the ticks before.
+ *
+ *   Last the pellet bitmap late in a level, one pellet in BENCH_SPARSE left:
+ *   counting them, counting them in random rectangles and finding the
+ *   nearest one to random tiles, against going over every tile for the same
+ *   answer. Any answer that is not the same as the scan's fails the
+ *   benchmarks.
+ */
+
+#include <unistd.h>
+#include <limits.h>
+#include <math.h>
+
+#include "packman.h"
+#include "viewport.h"
+#include "snapshot.h"
+#include "blit.h"
+#include "levelgen.h"
+#include "pellets.h"
+
+   /* roughly how many tiles each flood measurement touches */
+#define BENCH_TILES (1<<25)
+   /* frames drawn for each render measurement */
+#define BENCH_FRAMES 500
+   /* game ticks for each tick measurement */
+#define BENCH_TICKS 200
+   /* side of the crowded grid, and enemies on it */
+#define BENCH_CROWD 41
+#define BENCH_CROWD_ENEMIES 64
+   /* ticks on it, two junctions' worth and not yet at the player */
+#define BENCH_CROWD_TICKS 50
+
+   /* pellets left, one in this many, for the pellet measurements */
+#define BENCH_SPARSE 1000
+   /* pellets_in and nearest_pellet calls for each pellet measurement */
+#define BENCH_QUERIES 10000
+
+static volatile long bench_sink;
+
+   /* a rectangle [x0,x1) x [y0,y1) anywhere on the level, of any size */
+static void random_region(int *x0, int *y0, int *x1, int *y1)
+{
+   *x0 = rand()%width;
+   *y0 = rand()%height;
+   *x1 = *x0 + 1 + rand()%(width-*x0);
+   *y1 = *y0 + 1 + rand()%(height-*y0);
+}
+
+   /* an n x n level, n odd, where every tile with both coordinates odd is a
+      junction. The player is in the middle and enemies start half way between
+      the junctions nearest it, so they all get to one in the same tick */
+static int write_crowd(const char *path, int n, int enemies)
+{
+   FILE *out = fopen(path, "w");
+
+   if (out==NULL)
+      return 0;
+
+   fprintf(out, "%dx%d\n", n, n);
+   for (int y=0; y<n; y++)
+   {
+      for (int x=0; x<n; x++)
+      {
+         int dist = abs(x-n/2) + abs(y-n/2);
+         char c = (x%2==0 && y%2==0) || x==0 || y==0 || x==n-1 || y==n-1 ? '#' : 'o';
+
+            /* rings from 4 tiles out, as far as it takes */
+         if (x==n/2 && y==n/2)
+            c = 'P';
+         else if (x%2==1 && y%2==0 && c!='#' && dist>=4 && enemies>0 && dist<=4+2*(int)(sqrt(enemies)))
+            c = 'E';
+
+         if (c=='E')
+            enemies--;
+         fputc(c, out);
+      }
+      if (y!=n-1)
+         fputc('\n', out);
+   }
+
+   return fclose(out)==0;
+}
+
+int run_benchmarks()
+{
+   static const int sizes[] = { 20, 64, 256, 1024, 4096 };
+   char path[] = "/tmp/packman_benchXXXXXX";
+   int fd;
+
+   if ((fd = mkstemp(path))==-1){
+      printf("\ncould not make a temporary level file\n");
+      return 1;
+   }
+   close(fd);
+
+   printf("tile layout: %s\n", tile_layout_name());
+   printf("%10s %18s %18s %18s\n", "map", "flood Mtiles/s", "render frames/s", "SDL blit frames/s");
+
+   for (unsigned int i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++)
+   {
+      int n = sizes[i];
+
+      if (!gen_maze_file(path, n, n, 1234+n, 1)
+         || !load_lvl(path,(char *)"assets/walls_small.png",(char *)"assets/background.png")){
+         printf("\ncould not load a %dx%d maze\n", n, n);
+         unlink(path);
+         return 1;
+      }
+
+      long tiles = (long)n*n;
+      int reps = std::max(2L, BENCH_TILES/tiles);
+
+         /* flood from alternating entities */
+      entity *first = entity_list;
+      entity *second = entity_list->next ? entity_list->next : entity_list;
+
+      long flooded = 0;
+
+      Uint64 start = usec_now();
+      for (int r=0; r<reps; r++)
+         flooded += flood_distances(r%2 ? second : first);
+      Uint64 flood_time = std::max(usec_now()-start, (Uint64)1);
+
+      snap_game(0);
+
+      start = usec_now();
+      for (int r=0; r<BENCH_FRAMES; r++)
+         draw_game(latest_snapshot());
+      Uint64 render_time = std::max(usec_now()-start, (Uint64)1);
+
+         /* the same frames with every pellet and sprite through SDL_BlitSurface */
+      blit_direct = false;
+      start = usec_now();
+      for (int r=0; r<BENCH_FRAMES; r++)
+         draw_game(latest_snapshot());
+      Uint64 sdl_time = std::max(usec_now()-start, (Uint64)1);
+      blit_direct = true;
+
+      char name[32];
+      snprintf(name, 32, "%dx%d", n, n);
+      printf("%10s %18.1f %18.1f %18.1f\n", name,
+         (double)flooded/flood_time, 1000000.0*BENCH_FRAMES/render_time, 1000000.0*BENCH_FRAMES/sdl_time);
+
+      cleanuplvl();
+   }
+
+   static const int tick_sizes[] = { 64, 128, 256 };
+
+   printf("%10s %8s %14s %18s\n", "map", "enemies", "ticks/s", "decisions/tick");
+
+   for (unsigned int i=0; i<sizeof(tick_sizes)/sizeof(tick_sizes[0]); i++)
+   {
+      int n = tick_sizes[i];
+      int enemies = n*n/400;
+
+      if (!gen_maze_file(path, n, n, 4321+n, enemies)
+         || !load_lvl(path,(char *)"assets/walls_small.png",(char *)"assets/background.png")){
+         printf("\ncould not load a %dx%d maze\n", n, n);
+         unlink(path);
+         return 1;
+      }
+
+      long decisions = ai_decisions;
+
+      Uint64 start = usec_now();
+      for (int r=0; r<BENCH_TICKS; r++){
+         stream_chunks();
+         move_entities(1);
+      }
+      Uint64 tick_time = std::max(usec_now()-start, (Uint64)1);
+
+      char name[32];
+      snprintf(name, 32, "%dx%d", n, n);
+      printf("%10s %8d %14.1f %18.2f\n", name, enemies,
+         1000000.0*BENCH_TICKS/tick_time, (double)(ai_decisions-decisions)/BENCH_TICKS);
+
+      cleanuplvl();
+   }
+
+   if (!write_crowd(path, BENCH_CROWD, BENCH_CROWD_ENEMIES)
+      || !load_lvl(path,(char *)"assets/walls_small.png",(char *)"assets/background.png")){
+      printf("\ncould not load the crowded grid\n");
+      unlink(path);
+      return 1;
+   }
+
+   int enemies = 0;
+   for (entity *ent=entity_list; ent!=NULL; ent=ent->next)
+      enemies += ent->type=='E';
+
+   long decisions = ai_decisions, planned = ai_planned, missed = ai_missed;
+   long most = 0;
+   Uint64 worst = 0;
+
+   for (int r=0; r<BENCH_CROWD_TICKS; r++)
+   {
+      long before = ai_decisions;
+      Uint64 start = usec_now();
+
+      move_entities(1);
+      worst = std::max(worst, usec_now()-start);
+      most = std::max(most, ai_decisions-before);
+   }
+
+   printf("%10s %8s %14s %18s %14s %14s\n", "crowd", "enemies", "decisions", "most in a tick", "decided ahead", "missed");
+   printf("%7dx%d %8d %14ld %18ld %14ld %14ld   worst tick %.2f ms\n", BENCH_CROWD, BENCH_CROWD, enemies,
+      ai_decisions-decisions, most, ai_planned-planned, ai_missed-missed, worst/1000.0);
+
+   cleanuplvl();
+
+   static const int pellet_sizes[] = { 256, 1024, 4096 };
+
+   printf("%10s %8s %16s %16s %16s %16s %16s %16s\n", "map", "pellets", "count/s", "scan count/s",
+      "region/s", "scan region/s", "nearest/s", "scan nearest/s");
+
+   for (unsigned int i=0; i<sizeof(pellet_sizes)/sizeof(pellet_sizes[0]); i++)
+   {
+      int n = pellet_sizes[i];
+
+      if (!gen_maze_file(path, n, n, 5678+n, 1)
+         || !load_lvl(path,(char *)"assets/walls_small.png",(char *)"assets/background.png")){
+         printf("\ncould not load a %dx%d maze\n", n, n);
+         unlink(path);
+         return 1;
+      }
+
+      srand(n);
+      for (int y=0; y<height; y++)
+         for (int x=0; x<width; x++)
+            if (tile_at(x,y).type=='o' && rand()%BENCH_SPARSE!=0 && pellet_clear(x,y))
+               tile_at(x,y).type = '_';
+
+      long tiles = (long)n*n;
+      int reps = std::max(2L, BENCH_TILES/tiles);
+      long found = 0;
+      int scanned = 0;
+      int wrong = 0;
+
+      Uint64 start = usec_now();
+      for (int r=0; r<reps; r++)
+         found += count_pellets();
+      Uint64 count_time = std::max(usec_now()-start, (Uint64)1);
+
+      start = usec_now();
+      for (int r=0; r<reps; r++)
+      {
+         scanned = 0;
+         for (int y=0; y<height; y++)
+            for (int x=0; x<width; x++)
+               scanned += tile_at(x,y).type=='o';
+         found += scanned;
+      }
+      Uint64 scan_count_time = std::max(usec_now()-start, (Uint64)1);
+
+      if (count_pellets()!=scanned || packets!=scanned)
+         wrong++;
+
+      int x0, y0, x1, y1;
+
+      start = usec_now();
+      for (int r=0; r<BENCH_QUERIES; r++){
+         random_region(&x0, &y0, &x1, &y1);
+         found += pellets_in(x0, y0, x1, y1);
+      }
+      Uint64 region_time = std::max(usec_now()-start, (Uint64)1);
+
+      start = usec_now();
+      for (int r=0; r<reps; r++)
+      {
+         int in = 0;
+
+         random_region(&x0, &y0, &x1, &y1);
+         for (int y=y0; y<y1; y++)
+            for (int x=x0; x<x1; x++)
+               in += tile_at(x,y).type=='o';
+         found += in;
+
+         if (pellets_in(x0, y0, x1, y1)!=in)
+            wrong++;
+      }
+      Uint64 scan_region_time = std::max(usec_now()-start, (Uint64)1);
+
+      int px, py;
+
+      start = usec_now();
+      for (int r=0; r<BENCH_QUERIES; r++)
+         found += nearest_pellet(rand()%width, rand()%height, &px, &py);
+      Uint64 nearest_time = std::max(usec_now()-start, (Uint64)1);
+
+      start = usec_now();
+      for (int r=0; r<reps; r++)
+      {
+         int qx = rand()%width, qy = rand()%height;
+         int best = INT_MAX;
+
+         for (int y=0; y<height; y++)
+            for (int x=0; x<width; x++)
+               if (tile_at(x,y).type=='o')
+                  best = std::min(best, abs(x-qx)+abs(y-qy));
+         found += best;
+
+            /* the bitmap from the same tile, next to nothing against the scan */
+         if (nearest_pellet(qx, qy, &px, &py)!=(best==INT_MAX ? -1 : best))
+            wrong++;
+      }
+      Uint64 scan_nearest_time = std::max(usec_now()-start, (Uint64)1);
+      bench_sink = found;   //so none of it is optimized away
+
+      char name[32];
+      snprintf(name, 32, "%dx%d", n, n);
+      printf("%10s %8d %16.1f %16.1f %16.1f %16.1f %16.1f %16.1f\n", name, packets,
+         1000000.0*reps/count_time, 1000000.0*reps/scan_count_time,
+         1000000.0*BENCH_QUERIES/region_time, 1000000.0*reps/scan_region_time,
+         1000000.0*BENCH_QUERIES/nearest_time, 1000000.0*reps/scan_nearest_time);
+
+      cleanuplvl();
+
+      if (wrong){
+         printf("\nthe pellet bitmap gave %d answers that the scans did not\n", wrong);
+         unlink(path);
+         return 1;
+      }
+   }
+
+   unlink(path);
+
+   return 0;
+}
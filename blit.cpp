@@ -0,0 +1,212 @@
+/*
+ * Direct 32bpp blitter, see blit.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "blit.h"
+
+bool blit_direct = true;
+
+enum { ROW_CLEAR, ROW_MIXED, ROW_SOLID };
+
+struct sprite
+{
+   SDL_Surface *image;
+   int w;
+   int h;
+   Uint32 *pixels;   /* w*h, NULL if it has to go through SDL */
+   Uint32 *mask;   /* w*h, ~0 where opaque */
+   char *rows;   /* ROW_ for each row */
+};
+
+struct blit_job
+{
+   SDL_Surface *image;
+   int x;
+   int y;
+};
+
+static sprite *sprites = NULL;
+static int sprite_count = 0;
+static int sprite_room = 0;
+
+static blit_job *jobs = NULL;
+static int job_count = 0;
+static int job_room = 0;
+
+void blit_image(SDL_Surface *image, int x, int y)
+{
+   if (job_count==job_room){
+      job_room = job_room ? job_room*2 : 256;
+      jobs = (blit_job *) realloc(jobs, job_room*sizeof(blit_job));
+   }
+
+   jobs[job_count].image = image;
+   jobs[job_count].x = x;
+   jobs[job_count].y = y;
+   job_count++;
+}
+
+   /* copy out image's pixels and work out its mask, if it can be drawn directly onto dest */
+static void make_sprite(sprite *spr, SDL_Surface *image, SDL_Surface *dest)
+{
+   memset(spr, 0, sizeof(sprite));
+   spr->image = image;
+   spr->w = image->w;
+   spr->h = image->h;
+
+   if (image->format->BytesPerPixel!=4 || dest->format->BytesPerPixel!=4
+      || image->format->Rmask!=dest->format->Rmask || image->format->Gmask!=dest->format->Gmask
+      || image->format->Bmask!=dest->format->Bmask || (image->flags & SDL_SRCALPHA))
+      return;
+
+   spr->pixels = (Uint32 *) malloc(spr->w*spr->h*sizeof(Uint32));
+   spr->mask = (Uint32 *) malloc(spr->w*spr->h*sizeof(Uint32));
+   spr->rows = (char *) malloc(spr->h);
+
+   if (SDL_MUSTLOCK(image))
+      SDL_LockSurface(image);
+
+   bool keyed = image->flags & SDL_SRCCOLORKEY;
+
+   for (int y=0; y<spr->h; y++)
+   {
+      Uint32 *src = (Uint32 *)((char *)image->pixels + y*image->pitch);
+      int opaque = 0;
+
+      for (int x=0; x<spr->w; x++)
+      {
+         bool clear = keyed && src[x]==image->format->colorkey;
+
+         spr->pixels[y*spr->w+x] = src[x];
+         spr->mask[y*spr->w+x] = clear ? 0 : ~(Uint32)0;
+         opaque += !clear;
+      }
+
+      spr->rows[y] = opaque==0 ? ROW_CLEAR : opaque==spr->w ? ROW_SOLID : ROW_MIXED;
+   }
+
+   if (SDL_MUSTLOCK(image))
+      SDL_UnlockSurface(image);
+}
+
+static sprite *find_sprite(SDL_Surface *image, SDL_Surface *dest)
+{
+   for (int i=0; i<sprite_count; i++)
+      if (sprites[i].image==image)
+         return &sprites[i];
+
+   if (sprite_count==sprite_room){
+      sprite_room = sprite_room ? sprite_room*2 : 8;
+      sprites = (sprite *) realloc(sprites, sprite_room*sizeof(sprite));
+   }
+
+   make_sprite(&sprites[sprite_count], image, dest);
+   return &sprites[sprite_count++];
+}
+
+static void draw_row(Uint32 *dst, const Uint32 *src, const Uint32 *mask, int n)
+{
+   int i = 0;
+
+#ifdef __SSE2__
+   for (; i+4<=n; i+=4)
+   {
+      __m128i s = _mm_loadu_si128((const __m128i *)(src+i));
+      __m128i m = _mm_loadu_si128((const __m128i *)(mask+i));
+      __m128i d = _mm_loadu_si128((const __m128i *)(dst+i));
+
+      _mm_storeu_si128((__m128i *)(dst+i), _mm_or_si128(_mm_and_si128(s, m), _mm_andnot_si128(m, d)));
+   }
+#endif
+
+   for (; i<n; i++)
+      dst[i] = (dst[i] & ~mask[i]) | (src[i] & mask[i]);
+}
+
+   /* spr at x,y on dest, clipped to dest's clip rect. dest is locked */
+static void draw_sprite(sprite *spr, int x, int y, SDL_Surface *dest)
+{
+   int x0 = std::max(x, (int)dest->clip_rect.x);
+   int y0 = std::max(y, (int)dest->clip_rect.y);
+   int x1 = std::min(x+spr->w, dest->clip_rect.x+dest->clip_rect.w);
+   int y1 = std::min(y+spr->h, dest->clip_rect.y+dest->clip_rect.h);
+
+   if (x0>=x1 || y0>=y1)
+      return;
+
+   for (int row=y0-y; row<y1-y; row++)
+   {
+      if (spr->rows[row]==ROW_CLEAR)
+         continue;
+
+      Uint32 *dst = (Uint32 *)((char *)dest->pixels + (y+row)*dest->pitch) + x0;
+      int at = row*spr->w + (x0-x);
+
+      if (spr->rows[row]==ROW_SOLID)
+         memcpy(dst, spr->pixels+at, (x1-x0)*sizeof(Uint32));
+      else
+         draw_row(dst, spr->pixels+at, spr->mask+at, x1-x0);
+   }
+}
+
+void blit_flush(SDL_Surface *dest)
+{
+   bool locked = false;
+   sprite *spr = NULL;
+
+   for (int i=0; i<job_count; i++)
+   {
+      blit_job *job = &jobs[i];
+
+         /* pellets come in long runs of the same image */
+      if (blit_direct && (spr==NULL || spr->image!=job->image))
+         spr = find_sprite(job->image, dest);
+
+      if (!blit_direct || spr->pixels==NULL){
+         if (locked){
+            SDL_UnlockSurface(dest);
+            locked = false;
+         }
+         apply_surface(job->x, job->y, job->image, dest);
+         continue;
+      }
+
+      if (!locked && SDL_MUSTLOCK(dest)){
+         if (SDL_LockSurface(dest)<0)
+            break;
+         locked = true;
+      }
+
+      draw_sprite(spr, job->x, job->y, dest);
+   }
+
+   if (locked)
+      SDL_UnlockSurface(dest);
+
+   job_count = 0;
+}
+
+void free_blits()
+{
+   for (int i=0; i<sprite_count; i++){
+      free(sprites[i].pixels);
+      free(sprites[i].mask);
+      free(sprites[i].rows);
+   }
+
+   free(sprites);
+   sprites = NULL;
+   sprite_count = sprite_room = 0;
+
+   free(jobs);
+   jobs = NULL;
+   job_count = job_room = 0;
+}
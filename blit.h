@@ -0,0 +1,27 @@
+#ifndef BLIT_H
+#define BLIT_H
+
+#include "packman.h"
+
+/*
+ *  Drawing pellets and sprites straight into a 32bpp screen.
+ *
+ *  blit_image() queues an image for the frame instead of blitting it there
+ *  and then, blit_flush() draws the whole queue with the screen locked once.
+ *  The first time an image is seen its pixels are copied out along with a
+ *  mask that is all ones where it is opaque and all zeros where it has the
+ *  colour key, so drawing a row is (screen & ~mask) | (pixels & mask), four
+ *  pixels at a time with SSE2. Rows that are all opaque are copied whole and
+ *  rows that are all colour key are skipped.
+ *
+ *  Anything that is not 32bpp in the screen's own format, and everything when
+ *  blit_direct is false, goes through apply_surface like before.
+ */
+
+extern bool blit_direct;   /* false to draw the queue with SDL_BlitSurface, for comparing */
+
+void blit_image(SDL_Surface *image, int x, int y);   /* queue image at x,y, like apply_surface onto the screen */
+void blit_flush(SDL_Surface *dest);   /* draw everything queued, in order */
+void free_blits();   /* forget every image seen, before they are freed */
+
+#endif
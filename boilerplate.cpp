@@ -1,6 +1,9 @@
 
 
+#include <time.h>
+
 #include "boilerplate.h"
+#include "assets.h"
 
 SDL_Surface *screen;
 SDL_Event event;
@@ -14,8 +17,13 @@ SDL_Surface *load_image( char* filename )
    //The optimized image that will be used
    SDL_Surface* optimizedImage = NULL;
     
+      //Straight from the pack if it is in there
+   optimizedImage = asset_image( filename );
+   if( optimizedImage != NULL )
+      return optimizedImage;
+
    //Load the image
-   loadedImage = IMG_Load( filename );
+   loadedImage = IMG_Load( data_path(filename) );
     
    //If the image loaded
    if( loadedImage != NULL )
@@ -55,11 +63,21 @@ void apply_surface( int x, int y, SDL_Surface* source, SDL_Surface* destination,
    SDL_BlitSurface( source, clip, destination, &offset );
 }
 
+   /* monotonic clock in microseconds, for timing */
+Uint64 usec_now()
+{
+   struct timespec now;
+
+   clock_gettime(CLOCK_MONOTONIC, &now);
+
+   return (Uint64)now.tv_sec*1000000 + now.tv_nsec/1000;
+}
+
 /* initialize SDL and subsystems */
 bool init()
 {
-      //Initialize all SDL subsystems
-   if ( SDL_Init( SDL_INIT_EVERYTHING ) == -1 || TTF_Init()==-1 )
+      //Initialize only video, SDL_ttf starts later if text is drawn without a pack
+   if ( SDL_Init( SDL_INIT_VIDEO ) == -1 )
       return false;
 
 
@@ -18,6 +18,7 @@ bool init();   /* initialize SDL and subsystems */
 SDL_Surface *load_image( char* filename );   /* Load a new image from a filename */
    /* apply surface to either another surface or the screen */
 void apply_surface( int x, int y, SDL_Surface* source, SDL_Surface* destination, SDL_Rect* clip = NULL );
+Uint64 usec_now();   /* monotonic clock in microseconds, for timing */
 
 #endif
 
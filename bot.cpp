@@ -0,0 +1,367 @@
+/*
+ * The player bot and soak runs, see bot.h.
+ *
+ *   A flood leaves its distances on the tiles themselves, so each enemy's is
+ *   copied into near[] before the next flood. The bot's own flood is last;
+ *   flood_queue then holds every tile it reached nearest first, so the first
+ *   pellets in it are the nearest ones, and every tile's way back to the bot
+ *   is worked out before the tiles past it. Of the ways back down the
+ *   distances the bot takes the one staying furthest ahead of the enemies.
+ */
+
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <limits.h>
+#include <algorithm>
+
+#include "bot.h"
+#include "kinds.h"
+#include "input.h"
+#include "search.h"
+#include "rewind.h"
+#include "arena.h"
+#include "assets.h"
+#include "pellets.h"
+
+const controller *player_controller = &key_controller;
+
+   /* for print_bot_stats */
+static long bot_decisions = 0;
+static long bot_runs = 0;   /* decisions with no safe pellet, running instead */
+
+static const int bot_dx[5] = { 0, 0, -1, 1, 0 };
+static const int bot_dy[5] = { 0, -1, 0, 0, 1 };
+
+struct bot_tile
+{
+   int enemy;   /* walking distance from the nearest enemy in sight */
+   unsigned int decision;   /* the bot_decisions enemy is from, none in sight if older */
+      /* the least the bot is ahead of the enemies anywhere on its best way
+         here, set for every tile of its own flood */
+   int ahead;
+};
+
+static bot_tile *near = NULL;
+static int near_tiles = 0;
+   /* pellet headed for at the last decision, kept while it stays safe */
+static int target = -1;
+
+static bool reached(int x, int y)
+{
+   return x>=0 && x<width && y>=0 && y<height && tile_at(x,y).type!='#' && tile_at(x,y).flood==flood_count;
+}
+
+   /* how far ahead of every enemy the bot gets to x,y, in its own tiles (an enemy takes
+      two to its one), INT_MAX with none in sight */
+static int ahead_at(int x, int y)
+{
+   bot_tile &tile = near[y*width + x];
+
+   if (tile.decision!=(unsigned int)bot_decisions)
+      return INT_MAX;
+
+   return 2*tile.enemy - tile_at(x,y).ent_val;
+}
+
+   /* the neighbour of x,y a step nearer the bot on its best way, -1 for none */
+static int back_from(int x, int y)
+{
+   int value = tile_at(x,y).ent_val;
+   int best = -1;
+
+   for (int d=1; d<=4; d++)
+   {
+      int nx = x+bot_dx[d], ny = y+bot_dy[d];
+
+      if (reached(nx,ny) && tile_at(nx,ny).ent_val==value-1
+         && (best<0 || near[ny*width + nx].ahead > near[best].ahead))
+         best = ny*width + nx;
+   }
+
+   return best;
+}
+
+   /* first step from sx,sy on the bot's best way to x,y */
+static int first_step(int sx, int sy, int x, int y)
+{
+   while (tile_at(x,y).ent_val>1)
+   {
+      int back = back_from(x,y);
+
+      if (back<0)
+         return 0;
+
+      x = back%width;
+      y = back/width;
+   }
+
+   for (int d=1; d<=4; d++)
+      if (sx+bot_dx[d]==x && sy+bot_dy[d]==y)
+         return d;
+
+   return 0;
+}
+
+   /* x,y can be got to keeping BOT_FEAR tiles ahead of the enemies */
+static bool safe(int x, int y)
+{
+   return reached(x,y) && tile_at(x,y).ent_val>0 && near[y*width + x].ahead > BOT_FEAR;
+}
+
+static int steer_bot(entity *ent, int x, int y)
+{
+   bot_decisions++;
+
+   if (near_tiles<width*height){
+      free(near);
+      near = (bot_tile *) calloc(width*height, sizeof(bot_tile));
+      near_tiles = near ? width*height : 0;
+      if (near==NULL)
+         return 0;
+   }
+
+   int in_sight = 0;
+
+   for (int i=0; i<kind_count[KIND_ENEMY]; i++)
+   {
+      entity *enemy = kind_batch[KIND_ENEMY][i];
+
+      if (abs(enemy->x/16-x) + abs(enemy->y/16-y) > BOT_SIGHT)
+         continue;
+      in_sight++;
+
+      int tiles = flood_distances(enemy);
+
+      near[(enemy->y/16)*width + enemy->x/16].enemy = 0;
+      near[(enemy->y/16)*width + enemy->x/16].decision = bot_decisions;
+
+      for (int j=0; j<tiles; j++){
+         bot_tile &tile = near[flood_queue[j]];
+         int value = tile_at(flood_queue[j]%width, flood_queue[j]/width).ent_val;
+
+         if (tile.decision!=(unsigned int)bot_decisions || value<tile.enemy){
+            tile.enemy = value;
+            tile.decision = bot_decisions;
+         }
+      }
+   }
+
+   int tiles = flood_distances(ent);
+
+      /* nearest first, so every tile's way back is done before it */
+   near[y*width + x].ahead = INT_MAX;
+   for (int i=0; i<tiles; i++)
+   {
+      int tx = flood_queue[i]%width;
+      int ty = flood_queue[i]/width;
+      int back = tile_at(tx,ty).ent_val==1 ? y*width + x : back_from(tx,ty);
+
+      near[flood_queue[i]].ahead = std::min(ahead_at(tx,ty), back>=0 ? near[back].ahead : INT_MIN);
+   }
+
+      /* the snitch wins the level outright, then the pellet from last time, then the nearest */
+   if (kind_count[KIND_SNITCH]>0){
+      entity *snitch = kind_batch[KIND_SNITCH][0];
+
+      if (safe(snitch->x/16, snitch->y/16))
+         return first_step(x, y, snitch->x/16, snitch->y/16);
+   }
+
+   if (target>=0 && target<width*height && pellet_at(target%width, target/width)
+      && safe(target%width, target/width))
+      return first_step(x, y, target%width, target/width);
+
+   for (int i=0; i<tiles; i++)
+   {
+      int tx = flood_queue[i]%width;
+      int ty = flood_queue[i]/width;
+
+      if (pellet_at(tx,ty) && safe(tx,ty)){
+         target = flood_queue[i];
+         return first_step(x, y, tx, ty);
+      }
+   }
+
+      /* with no enemy in sight every pellet reached is safe, so the ones left
+         are past FLOOD_HORIZON: towards the tile reached nearest the nearest
+         pellet of all */
+   int px, py;
+
+   if (in_sight==0 && nearest_pellet(x, y, &px, &py)>=0){
+      int closest = -1;
+      int closest_dist = INT_MAX;
+
+      for (int i=0; i<tiles; i++)
+      {
+         int tx = flood_queue[i]%width;
+         int ty = flood_queue[i]/width;
+         int dist = abs(tx-px) + abs(ty-py);
+
+         if (dist<closest_dist && tile_at(tx,ty).ent_val>0){
+            closest = flood_queue[i];
+            closest_dist = dist;
+         }
+      }
+
+      if (closest>=0 && closest_dist < abs(x-px) + abs(y-py))
+         return first_step(x, y, closest%width, closest/width);
+   }
+
+      /* nothing safe to eat: towards the tile furthest from the enemies that
+         it still gets to first, leaving out dead ends. If there is none, the
+         one it stays furthest ahead on the way to */
+   int best = -1;
+   int best_enemy = -1;
+
+   bot_runs++;
+   target = -1;
+   for (int i=0; i<tiles; i++)
+   {
+      int tx = flood_queue[i]%width;
+      int ty = flood_queue[i]/width;
+      int enemy = near[flood_queue[i]].decision==(unsigned int)bot_decisions ? near[flood_queue[i]].enemy : INT_MAX;
+      int ways = 0;
+
+      if (near[flood_queue[i]].ahead>BOT_CONTACT)
+         enemy = std::max(enemy, 0);
+      else
+         enemy = -1;
+
+      if (best>=0 && (enemy<best_enemy
+         || (enemy==best_enemy && near[flood_queue[i]].ahead<=near[best].ahead)))
+         continue;
+
+      for (int d=1; d<=4; d++)
+         ways += tile_at(tx+bot_dx[d], ty+bot_dy[d]).type!='#';
+
+      if (ways>1){
+         best = flood_queue[i];
+         best_enemy = enemy;
+      }
+   }
+
+   return best>=0 ? first_step(x, y, best%width, best/width) : 0;
+}
+
+const controller bot_controller = { "bot", steer_bot };
+
+void print_bot_stats()
+{
+   if (bot_decisions==0)
+      return;
+
+   printf("bot: %ld decisions, %ld of them running from enemies\n", bot_decisions, bot_runs);
+
+   free(near);
+   near = NULL;
+   near_tiles = 0;
+}
+
+/* soak runs */
+
+static volatile sig_atomic_t soak_stop = 0;
+
+static void stop_soak(int sig)
+{
+   soak_stop = 1;
+}
+
+static long resident_kb()
+{
+   long pages = 0, resident = 0;
+   FILE *statm = fopen("/proc/self/statm", "r");
+
+   if (statm==NULL)
+      return 0;
+   if (fscanf(statm, "%ld %ld", &pages, &resident)!=2)
+      resident = 0;
+   fclose(statm);
+
+   return resident*(sysconf(_SC_PAGESIZE)/1024);
+}
+
+static bool soak_level(char *lvl_file)
+{
+   cleanuplvl();
+   packets = 0;
+   has_won = 0;
+   reset_input();
+
+   return load_lvl(lvl_file,(char *)"assets/walls_small.png",(char *)"assets/background.png") && player!=NULL;
+}
+
+int run_soak(char *first_level, int seconds)
+{
+   long ticks = 0, won = 0, lost = 0, deaths = 0;
+   long report_ticks = 0;
+   Uint64 started = usec_now();
+   Uint64 report_at = started;
+   char text[32];
+
+   signal(SIGINT, stop_soak);
+   signal(SIGTERM, stop_soak);
+
+   while (!soak_stop)
+   {
+      stream_chunks();
+      search_think(search_budget);
+
+      for (entity *ent_ptr=entity_list; ent_ptr!=NULL; ent_ptr=ent_ptr->next){
+         ent_ptr->prev_x = ent_ptr->x;
+         ent_ptr->prev_y = ent_ptr->y;
+      }
+
+      int was_losses = losses;
+
+      move_entities(1);
+      rewind_record();
+      snap_game(1);
+      ticks++;
+      deaths += losses-was_losses;
+
+         /* on to the next level won or lost, so every level gets played. Back to
+            the first after the last */
+      if (packets<=0 || has_won || losses>=deaths_to_lose){
+         if (packets<=0 || has_won)
+            won++;
+         else{
+            lost++;
+            losses = 0;
+         }
+
+         level++;
+         snprintf(text, 32, "levels/level%d", level);
+
+         if (access(data_path(text), R_OK)!=0 || !soak_level(text)){
+            level = 0;
+            if (!soak_level(first_level)){
+               printf("\nsoak: %s would not load\n", first_level);
+               return 1;
+            }
+         }
+      }
+
+      if ((ticks&1023)==0){
+         Uint64 now = usec_now();
+
+         if (now-report_at >= SOAK_REPORT*1000000ull){
+            printf("\nsoak: %ld ticks, %.0f a second, %ld levels won %ld lost, %ld deaths, %ld KB resident, %lu KB in the arena\n",
+               ticks, (ticks-report_ticks)*1e6/(now-report_at), won, lost, deaths, resident_kb(), (unsigned long)(arena_held/1024));
+            fflush(stdout);
+            report_at = now;
+            report_ticks = ticks;
+         }
+
+         if (seconds>0 && now-started >= seconds*1000000ull)
+            break;
+      }
+   }
+
+   Uint64 took = usec_now()-started;
+
+   printf("\nsoak: %ld ticks in %.1f s, %.0f a second, %ld levels won %ld lost, %ld deaths, %ld KB resident\n",
+      ticks, took/1e6, took ? ticks*1e6/took : 0.0, won, lost, deaths, resident_kb());
+
+   return 0;
+}
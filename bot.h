@@ -0,0 +1,51 @@
+#ifndef BOT_H
+#define BOT_H
+
+#include "packman.h"
+
+/*
+ *  Who steers the player.
+ *
+ *  choosedir() asks player_controller for a direction every time the player
+ *  is on a tile. key_controller is the arrow keys through input.h, the
+ *  default. bot_controller plays by itself: it floods from every enemy in
+ *  sight with flood_distances, like the enemies do from each other, and from
+ *  itself, then heads for the snitch or the nearest pellet it can get to
+ *  while staying more than BOT_FEAR ahead of every enemy. With none it runs
+ *  for the tile furthest from them that it still gets to first, and with no
+ *  enemy and no pellet in reach it heads for nearest_pellet() (pellets.h).
+ *  It keeps a few ints for every tile of the level, so it is not meant for
+ *  huge chunked levels.
+ *
+ *  'Packman bot' plays in the window as usual. 'Packman soak [seconds]' has
+ *  no window and no tick rate: the bot plays every level in turn, won or
+ *  lost, over and over as fast as it can, printing ticks a second and memory
+ *  in use every SOAK_REPORT seconds, until the time is up or ctrl-c.
+ */
+
+   /* enemies further than this, straight across, are not flooded */
+#define BOT_SIGHT 12
+   /* the bot's own tiles it wants to be ahead of every enemy anywhere on its
+      way to a pellet. An enemy takes two of them to walk a tile */
+#define BOT_FEAR 3
+   /* as near as the bot can get to where an enemy will be without touching it */
+#define BOT_CONTACT 2
+   /* seconds between soak reports */
+#define SOAK_REPORT 5
+
+struct controller
+{
+   const char *name;
+      /* direction to set off in from tile x,y, 0 to stand. Only called on the
+         simulation side, with the player exactly on the tile */
+   int (*steer)(entity *player, int x, int y);
+};
+
+extern const controller key_controller;   /* packman.cpp */
+extern const controller bot_controller;
+extern const controller *player_controller;   /* key_controller unless 'bot' or 'soak' */
+
+int run_soak(char *first_level, int seconds);   /* returns 0 once the time is up or stopped with ctrl-c */
+void print_bot_stats();
+
+#endif
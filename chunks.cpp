@@ -0,0 +1,549 @@
+/*
+ * Chunked levels, for maps too big to keep in memory as one game_field.
+ *
+ *   A chunked level file is a header, the CHUNK x CHUNK tile types of every
+ *   chunk, the entities, an index with the file offset of each chunk and the
+ *   pellet bitmap of pellets.h, summaries and all. Chunks that are all wall
+ *   share one copy through the index. Opening a level maps the bitmap as it
+ *   is, so nothing has to read every chunk to find the pellets.
+ *
+ *   Built with TILE_LAYOUT=TILE_CHUNKED the file is memory mapped and
+ *   tile_at() brings chunks in as they are touched. Once a tick
+ *   stream_chunks() pins the chunks around every awake entity and evicts the
+ *   least recently pinned others until the resident chunks fit in
+ *   chunk_budget. Spawning counts every entity as a tick of its own, so the
+ *   chunks of far apart entities do not all stay in at once. Entities more
+ *   than CHUNK_AWAKE_RADIUS chunks from the player are asleep, neither moved
+ *   nor thinking, so what is pinned stays around the player however many
+ *   entities the level has.
+ *
+ *   Nothing pinned or loaded this tick is evicted before the next one. Only
+ *   being touched does not keep a chunk in, but the floods stop at
+ *   FLOOD_HORIZON, inside the pinned chunks, so a tile reference never
+ *   outlives its chunk mid tick. Evicted chunks write their tile types
+ *   (eaten packets) back to the private mapping and lose their AI values,
+ *   which the floods rebuild anyway, and the tiles sleeping entities hold,
+ *   which they take again once they wake and move on.
+ *
+ *   pack_level() turns a plain level file into a chunked one a band of
+ *   CHUNK rows at a time, so it works on levels of any size.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "packman.h"
+#include "arena.h"
+#include "pellets.h"
+
+#define CHUNK_MAGIC "PMCHUNK2"
+
+struct chunk_header
+{
+   char magic[8];
+
+   int32_t width;
+   int32_t height;
+      /* side of a chunk in tiles, must match CHUNK */
+   int32_t chunk;
+      /* packets on the level, spawn tiles of 'E' and '*' included */
+   int32_t packets;
+   int32_t entities;
+   int32_t unused;
+
+      /* file offset of the chunk_entity array */
+   uint64_t entity_offset;
+      /* file offset of the chunks_wide*chunks_high chunk offsets */
+   uint64_t index_offset;
+      /* file offset of the pellet_words(width,height) words of pellet bitmap, 8 byte aligned */
+   uint64_t pellet_offset;
+};
+
+struct chunk_entity
+{
+   char type;
+   char pad[3];
+   int32_t x;
+   int32_t y;
+};
+
+Tile **chunk_table = NULL;
+int chunks_wide = 0;
+size_t chunk_budget = 64<<20;
+
+   /* bytes in a resident chunk */
+#define CHUNK_BYTES (CHUNK*CHUNK*sizeof(Tile))
+
+/* level file stuff */
+
+static int band_value(char *band, int w, int x, int y)
+{
+   return (x<w) ? band[y*w + x] : '#';
+}
+
+int is_chunked_level(const char *lvl_file)
+{
+   char magic[8];
+   FILE *in = fopen(lvl_file, "rb");
+
+   if (in==NULL)
+      return 0;
+
+      /* older versions too, so open_chunked_level can say to pack them again */
+   int ok = fread(magic, 1, 8, in)==8 && memcmp(magic, CHUNK_MAGIC, 7)==0;
+   fclose(in);
+
+   return ok;
+}
+
+   /* convert a plain level file to a chunked one, returns 1 on success */
+int pack_level(const char *lvl_file, const char *out_file)
+{
+   FILE *in, *out;
+   chunk_header header;
+   int w=0, h=0;
+
+   if ((in = fopen(lvl_file, "r"))==NULL){
+      printf("\nlvl file %s not found\n", lvl_file);
+      return 0;
+   }
+
+   if (fscanf(in, "%dx%d\n", &w, &h)!=2 || w<=0 || h<=0){
+      printf("\nMust include level dimensions\n");
+      fclose(in);
+      return 0;
+   }
+
+   if ((out = fopen(out_file, "wb"))==NULL){
+      printf("\ncould not write %s\n", out_file);
+      fclose(in);
+      return 0;
+   }
+
+   int wide = (w+CHUNK-1)/CHUNK;
+   int high = (h+CHUNK-1)/CHUNK;
+
+   char *band = (char*) malloc((size_t)w*CHUNK);
+   char *data = (char*) malloc(CHUNK*CHUNK);
+   uint64_t *index = (uint64_t*) malloc((size_t)wide*high*sizeof(uint64_t));
+   uint64_t *pellets = (uint64_t*) calloc(pellet_words(w, h), sizeof(uint64_t));
+   int blocks_wide = (w+PELLET_BLOCK-1)>>PELLET_SHIFT;
+   chunk_entity *ents = NULL;
+   int nents = 0, ents_room = 0;
+   uint64_t wall_offset = 0;
+   int ok = band!=NULL && data!=NULL && index!=NULL && pellets!=NULL;
+
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, CHUNK_MAGIC, 8);
+   header.width = w;
+   header.height = h;
+   header.chunk = CHUNK;
+
+      /* header goes in last, once the offsets are known */
+   ok = ok && fwrite(&header, sizeof(header), 1, out)==1;
+
+   for (int cy=0; ok && cy<high; cy++)
+   {
+         /* read a band of CHUNK rows */
+      int rows = std::min(CHUNK, h-cy*CHUNK);
+
+      for (int row=0; ok && row<rows; row++)
+      {
+         int x=0;
+         int c;
+
+         while ((c=fgetc(in))!=EOF && c!='\n')
+         {
+            if (c=='\r')
+               continue;
+            if (x>=w){
+               printf("\nBad level layout, row %d is too long\n", cy*CHUNK+row);
+               ok = 0;
+               break;
+            }
+
+            int y = cy*CHUNK+row;
+
+            if (c=='E' || c=='*' || c=='P'){
+               if (nents==ents_room){
+                  ents_room = ents_room ? 2*ents_room : 64;
+                  ents = (chunk_entity*) realloc(ents, ents_room*sizeof(chunk_entity));
+                  if (ents==NULL){
+                     ok = 0;
+                     break;
+                  }
+               }
+               memset(&ents[nents], 0, sizeof(chunk_entity));
+               ents[nents].type = c;
+               ents[nents].x = x;
+               ents[nents].y = y;
+               nents++;
+
+                  /* enemies and snitches start on a packet, like in load_lvl */
+               if (c!='P')
+                  c = 'o';
+            }
+            if (c=='o'){
+               header.packets++;
+               pellets[(y>>PELLET_SHIFT)*blocks_wide + (x>>PELLET_SHIFT)] |= pellet_bit(x,y);
+            }
+
+            band[row*w + x++] = c;
+         }
+
+         if (ok && x!=w){
+            printf("\nBad level layout, a row is %d long\n", x);
+            ok = 0;
+         }
+      }
+
+      for (int row=rows; row<CHUNK; row++)
+         memset(band + row*w, '#', w);
+
+         /* write out the chunks of the band */
+      for (int cx=0; ok && cx<wide; cx++)
+      {
+         bool all_wall = true;
+
+         for (int y=0; y<CHUNK; y++)
+         {
+            for (int x=0; x<CHUNK; x++)
+            {
+               data[y*CHUNK + x] = band_value(band, w, cx*CHUNK+x, y);
+               all_wall = all_wall && data[y*CHUNK + x]=='#';
+            }
+         }
+
+         if (all_wall && wall_offset!=0){
+            index[cy*wide + cx] = wall_offset;
+            continue;
+         }
+
+         index[cy*wide + cx] = ftell(out);
+         if (all_wall)
+            wall_offset = index[cy*wide + cx];
+
+         ok = fwrite(data, CHUNK*CHUNK, 1, out)==1;
+      }
+   }
+
+   if (ok){
+      header.entities = nents;
+      header.entity_offset = ftell(out);
+      ok = nents==0 || fwrite(ents, sizeof(chunk_entity), nents, out)==(size_t)nents;
+   }
+   if (ok){
+      header.index_offset = ftell(out);
+      ok = fwrite(index, sizeof(uint64_t), (size_t)wide*high, out)==(size_t)wide*high;
+   }
+   if (ok){
+      static const char zeros[8] = { 0 };
+      size_t pad = (8 - ftell(out)%8) % 8;
+      size_t words = pellet_words(w, h);
+
+      sum_pellets(w, h, pellets);
+      ok = fwrite(zeros, 1, pad, out)==pad;
+      header.pellet_offset = ftell(out);
+      ok = ok && fwrite(pellets, sizeof(uint64_t), words, out)==words;
+   }
+   if (ok){
+      rewind(out);
+      ok = fwrite(&header, sizeof(header), 1, out)==1;
+   }
+
+   free(band);
+   free(data);
+   free(index);
+   free(pellets);
+   free(ents);
+   fclose(in);
+   if (fclose(out)!=0)
+      ok = 0;
+
+   return ok;
+}
+
+#if TILE_LAYOUT == TILE_CHUNKED
+
+/* streaming stuff */
+
+   /* the mapped level file */
+char *level_map = NULL;
+size_t level_map_size = 0;
+uint64_t *chunk_index = NULL;
+int chunks_high = 0;
+
+   /* stream pass that last pinned or loaded each chunk */
+unsigned int *chunk_stamp = NULL;
+unsigned int chunk_tick = 1;
+
+   /* indices of the resident chunks */
+int *resident = NULL;
+int resident_count = 0;
+int resident_room = 0;
+
+   /* for print_chunk_stats */
+long chunk_loads = 0;
+long chunk_evictions = 0;
+int resident_peak = 0;
+
+   /* least recently pinned resident chunk not pinned or loaded this pass, -1 if none */
+static int pick_victim()
+{
+   int victim = -1;
+
+   for (int i=0; i<resident_count; i++)
+   {
+      unsigned int stamp = chunk_stamp[resident[i]];
+
+      if (stamp!=chunk_tick && (victim==-1 || stamp<chunk_stamp[resident[victim]]))
+         victim = i;
+   }
+
+   return victim;
+}
+
+   /* drop resident chunk number i, handing back its tiles */
+static Tile *evict(int i)
+{
+   int idx = resident[i];
+   Tile *tiles = chunk_table[idx];
+   char *types = level_map + chunk_index[idx];
+
+      /* only eaten packets change, and only their pages get copied */
+   for (int t=0; t<CHUNK*CHUNK; t++)
+      if (types[t]!=tiles[t].type)
+         types[t] = tiles[t].type;
+
+   chunk_table[idx] = NULL;
+   resident[i] = resident[--resident_count];
+   chunk_evictions++;
+
+   return tiles;
+}
+
+Tile *load_chunk(int cx, int cy)
+{
+   int idx = cy*chunks_wide + cx;
+   Tile *tiles = NULL;
+
+   if (resident_count*CHUNK_BYTES>=chunk_budget){
+      int victim = pick_victim();
+
+      if (victim!=-1)
+         tiles = evict(victim);
+   }
+
+      /* over budget only when everything resident is in use this pass */
+   if (tiles==NULL)
+      tiles = (Tile*) malloc(CHUNK_BYTES);
+
+   if (resident_count==resident_room){
+      resident = (int*) level_grow(resident, resident_room*sizeof(int), (resident_room ? 2*resident_room : 256)*sizeof(int));
+      resident_room = resident_room ? 2*resident_room : 256;
+   }
+
+   if (tiles==NULL || resident==NULL){
+      printf("\nout of memory for level chunks\n");
+      exit(1);
+   }
+
+   memset(tiles, 0, CHUNK_BYTES);
+
+   char *types = level_map + chunk_index[idx];
+   for (int t=0; t<CHUNK*CHUNK; t++)
+      tiles[t].type = types[t];
+
+   chunk_table[idx] = tiles;
+   chunk_stamp[idx] = chunk_tick;
+   resident[resident_count++] = idx;
+
+   chunk_loads++;
+   resident_peak = std::max(resident_peak, resident_count);
+
+   return tiles;
+}
+
+void stream_chunks()
+{
+   chunk_tick++;
+
+   for (entity *ent_ptr=entity_list; ent_ptr!=NULL; ent_ptr=ent_ptr->next)
+   {
+      if (!entity_awake(ent_ptr))
+         continue;
+
+      int cx = ent_ptr->x/16/CHUNK;
+      int cy = ent_ptr->y/16/CHUNK;
+
+      for (int y=std::max(cy-CHUNK_PIN_RADIUS,0); y<=std::min(cy+CHUNK_PIN_RADIUS,chunks_high-1); y++)
+      {
+         for (int x=std::max(cx-CHUNK_PIN_RADIUS,0); x<=std::min(cx+CHUNK_PIN_RADIUS,chunks_wide-1); x++)
+         {
+            chunk_stamp[y*chunks_wide + x] = chunk_tick;
+
+            if (chunk_table[y*chunks_wide + x]==NULL)
+               load_chunk(x, y);
+         }
+      }
+   }
+
+   while (resident_count*CHUNK_BYTES>chunk_budget)
+   {
+      int victim = pick_victim();
+
+      if (victim==-1)
+         break;
+
+      free(evict(victim));
+   }
+}
+
+   /* map a chunked level, packing a plain one first, and spawn its entities */
+int open_chunked_level(const char *lvl_file)
+{
+   char packed[] = "/tmp/packman_levelXXXXXX";
+   const char *path = lvl_file;
+   chunk_header header;
+   struct stat st;
+   int fd;
+
+   if (!is_chunked_level(lvl_file)){
+      if ((fd = mkstemp(packed))==-1)
+         return 0;
+      close(fd);
+
+      if (!pack_level(lvl_file, packed)){
+         unlink(packed);
+         return 0;
+      }
+      path = packed;
+   }
+
+   fd = open(path, O_RDONLY);
+   if (path==packed)
+      unlink(packed);   //the mapping keeps it alive
+
+   if (fd==-1 || fstat(fd, &st)==-1 || (size_t)st.st_size<sizeof(header)){
+      if (fd!=-1)
+         close(fd);
+      return 0;
+   }
+
+      /* private and writable, eaten packets never reach the file */
+   level_map = (char*) mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+   close(fd);
+
+   if (level_map==MAP_FAILED){
+      level_map = NULL;
+      return 0;
+   }
+   level_map_size = st.st_size;
+
+   memcpy(&header, level_map, sizeof(header));
+
+   if (memcmp(header.magic, CHUNK_MAGIC, 8)!=0){
+      printf("\n%s was packed by an older Packman, pack it again\n", lvl_file);
+      close_chunked_level();
+      return 0;
+   }
+
+   width = header.width;
+   height = header.height;
+   chunks_wide = (width+CHUNK-1)/CHUNK;
+   chunks_high = (height+CHUNK-1)/CHUNK;
+
+   size_t chunks = (size_t)chunks_wide*chunks_high;
+
+   if (header.chunk!=CHUNK || width<=0 || height<=0 || header.entities<0
+      || header.index_offset+chunks*sizeof(uint64_t)>level_map_size
+      || header.entity_offset+(size_t)header.entities*sizeof(chunk_entity)>level_map_size
+      || header.pellet_offset%8!=0 || header.packets<0
+      || header.pellet_offset+pellet_words(width,height)*sizeof(uint64_t)>level_map_size){
+      printf("\nbad chunked level file\n");
+      close_chunked_level();
+      return 0;
+   }
+
+   chunk_index = (uint64_t*) (level_map + header.index_offset);
+   for (size_t i=0; i<chunks; i++){
+      if (chunk_index[i]+CHUNK*CHUNK>level_map_size){
+         printf("\nbad chunk offset in level file\n");
+         close_chunked_level();
+         return 0;
+      }
+   }
+
+   chunk_table = (Tile**) level_alloc(chunks*sizeof(Tile*));
+   chunk_stamp = (unsigned int*) level_alloc(chunks*sizeof(unsigned int));
+
+      /* a flood never gets further than FLOOD_HORIZON steps */
+   size_t flood_room = std::min((size_t)width*height,
+      (size_t)2*FLOOD_HORIZON*FLOOD_HORIZON + 2*FLOOD_HORIZON + 1);
+   flood_queue = (int*) level_alloc(flood_room*sizeof(int));
+
+      /* the whole level's pellets from the start, so nearest_pellet sees past
+         what is paged in. Eating them only copies the pages they are on */
+   map_pellets(width, height, (uint64_t*) (level_map + header.pellet_offset), header.packets);
+
+   chunk_entity *ents = (chunk_entity*) (level_map + header.entity_offset);
+   for (int i=0; i<header.entities; i++){
+      chunk_tick++;   //the chunk it holds a tile in can go again for the next one
+      if (ents[i].x>=0 && ents[i].x<width && ents[i].y>=0 && ents[i].y<height)
+         spawn_entity(ents[i].type, ents[i].x, ents[i].y);
+   }
+
+   stream_chunks();
+
+   return 1;
+}
+
+void close_chunked_level()
+{
+   while (resident_count>0)
+      free(chunk_table[resident[--resident_count]]);
+
+   if (level_map!=NULL)
+      munmap(level_map, level_map_size);
+
+   level_map = NULL;
+   chunk_index = NULL;
+   chunk_table = NULL;
+   chunk_stamp = NULL;
+   resident = NULL;
+   resident_room = 0;
+}
+
+void print_chunk_stats()
+{
+   printf("chunks: %ld loads, %ld evictions, %d resident, peak %d (%ld KB), budget %ld KB\n",
+      chunk_loads, chunk_evictions, resident_count, resident_peak,
+      (long)(resident_peak*CHUNK_BYTES/1024), (long)(chunk_budget/1024));
+}
+
+#else
+
+Tile *load_chunk(int cx, int cy)
+{
+   return NULL;
+}
+
+int open_chunked_level(const char *lvl_file)
+{
+   printf("\nchunked levels need a build with TILE_LAYOUT=TILE_CHUNKED\n");
+   return 0;
+}
+
+void close_chunked_level()
+{
+}
+
+void print_chunk_stats()
+{
+}
+
+#endif
@@ -0,0 +1,779 @@
+/*
+ * Heat recorder, see heat.h.
+ *
+ *   The file is a heat_header, the frames and then the index, a uint64_t file
+ *   offset for every frame. The header goes in last, once the index is
+ *   written, so a game that never got to stop_heat() leaves a file that says
+ *   it has no frames.
+ *
+ *   A frame is a heat_frame, its entities, then its planes as pairs of
+ *   varints: how many values are the same as in the frame before, then the
+ *   difference for the next one, zigzagged so small negative ones stay small.
+ *   A whole frame is the difference from all 0. Whatever is left after the
+ *   last pair is unchanged, and frames are padded to 4 bytes so the entities
+ *   can be read from the mapping as they are.
+ *
+ *   The simulation only copies the entities on the tiles, and the types when
+ *   a pellet came or went or the tiles covered moved. The writer works the
+ *   path values and distances out from those the way update_boardvalues does,
+ *   with its own breadth first floods that never leave the frame's tiles.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+#include "heat.h"
+#include "kinds.h"
+#include "pellets.h"
+#include "SDL/SDL_thread.h"
+
+#define HEAT_MAGIC "PMHEAT01"
+
+struct heat_header
+{
+   char magic[8];
+
+   int32_t planes;   /* must match HEAT_PLANES */
+   int32_t key_every;
+   uint64_t frames;
+      /* file offset of the frames offsets */
+   uint64_t index_offset;
+};
+
+struct heat_frame
+{
+   int32_t tick;
+   int32_t packets;
+   int32_t losses;
+   int32_t x0, y0, x1, y1;
+   int32_t entities;
+   int32_t key;   /* a whole frame */
+   uint32_t bytes;   /* of planes after the entities, before padding */
+};
+
+   /* a frame copied by the simulation, waiting for the writer */
+struct heat_slot
+{
+   heat_frame frame;
+
+   heat_entity *ents;
+   int ent_room;
+   int *planes;
+   size_t plane_room;
+   bool same_types;   /* types not copied, they are the last frame's */
+};
+
+bool heat_recording = false;
+
+   /* the queue, the simulation only moves queue_tail and the writer queue_head */
+static heat_slot slots[HEAT_QUEUE];
+static unsigned int queue_head = 0;
+static unsigned int queue_tail = 0;
+
+static SDL_Thread *writer = NULL;
+static SDL_mutex *heat_lock = NULL;
+static SDL_cond *heat_wake = NULL;
+static bool stopping = false;
+static bool writer_asleep = false;   /* only then does the simulation wake it */
+
+   /* the simulation's, the last frame queued and pellet_changes as it was */
+static heat_frame queued;
+static unsigned int queued_changes = 0;
+
+   /* the writer's */
+static FILE *out = NULL;
+static uint64_t out_at = 0;   /* where the next frame goes */
+static uint64_t *frame_index = NULL;
+static size_t index_room = 0;
+static long frames_written = 0;
+static long last_key = 0;
+static int *prev = NULL;   /* planes of the last frame written */
+static size_t prev_room = 0;
+static heat_frame prev_frame;
+static unsigned char *packed = NULL;
+static size_t packed_room = 0;
+static int *flood_mem = NULL;   /* work_out_values' four planes */
+static size_t flood_room = 0;
+
+   /* for print_heat_stats */
+static long frames_captured = 0;
+static long frames_dropped = 0;
+static Uint64 capture_usec = 0;
+static Uint64 write_usec = 0;
+static uint64_t raw_bytes = 0;   /* what the frames would have been as plain ints */
+
+   /* the reader's */
+static char *heat_map = NULL;
+static size_t heat_map_size = 0;
+static heat_header heat_head;
+static const uint64_t *heat_index = NULL;
+
+static bool grow(void **mem, size_t *room, size_t need, size_t size)
+{
+   if (need<=*room)
+      return true;
+
+   size_t bigger = std::max(need, *room*2);
+   void *more = realloc(*mem, bigger*size);
+
+   if (more==NULL)
+      return false;
+
+   *mem = more;
+   *room = bigger;
+   return true;
+}
+
+static int put_varint(unsigned char *p, uint32_t v)
+{
+   int n = 0;
+
+   while (v>=0x80){
+      p[n++] = (v & 0x7F) | 0x80;
+      v >>= 7;
+   }
+   p[n++] = v;
+
+   return n;
+}
+
+static const unsigned char *get_varint(const unsigned char *p, const unsigned char *end, uint32_t *v)
+{
+   *v = 0;
+
+   for (int shift=0; p<end && shift<35; shift+=7)
+   {
+      *v |= (uint32_t)(*p & 0x7F) << shift;
+      if (!(*p++ & 0x80))
+         return p;
+   }
+
+   return NULL;
+}
+
+   /* on the tiles or partly, like the snapshot's entities */
+static bool on_tiles(entity *ent, int x0, int y0, int x1, int y1)
+{
+   return ent->x/16>=x0-1 && ent->x/16<x1 && ent->y/16>=y0-1 && ent->y/16<y1;
+}
+
+void heat_capture(unsigned int tick, int x0, int y0, int x1, int y1)
+{
+   if (!heat_recording)
+      return;
+
+   unsigned int tail = __atomic_load_n(&queue_tail, __ATOMIC_RELAXED);
+
+   if (tail - __atomic_load_n(&queue_head, __ATOMIC_ACQUIRE) >= HEAT_QUEUE){
+      frames_dropped++;
+      return;
+   }
+
+   Uint64 started = usec_now();
+   heat_slot *slot = &slots[tail%HEAT_QUEUE];
+   size_t tiles = (size_t)(x1-x0)*(y1-y0);
+   int count = 0;
+
+   for (entity *ent=entity_list; ent!=NULL; ent=ent->next)
+      if (on_tiles(ent, x0, y0, x1, y1))
+         count++;
+
+   size_t ent_room = slot->ent_room;
+
+   if (!grow((void **)&slot->ents, &ent_room, count, sizeof(heat_entity))
+      || !grow((void **)&slot->planes, &slot->plane_room, tiles*HEAT_PLANES, sizeof(int))){
+      slot->ent_room = ent_room;
+      frames_dropped++;
+      return;
+   }
+   slot->ent_room = ent_room;
+
+   heat_frame *fr = &slot->frame;
+
+   fr->tick = tick;
+   fr->packets = packets;
+   fr->losses = losses;
+   fr->x0 = x0;
+   fr->y0 = y0;
+   fr->x1 = x1;
+   fr->y1 = y1;
+   fr->entities = count;
+
+   slot->same_types = queued_changes==pellet_changes
+      && x0==queued.x0 && y0==queued.y0 && x1==queued.x1 && y1==queued.y1;
+
+   count = 0;
+   for (entity *ent=entity_list; ent!=NULL; ent=ent->next)
+   {
+      if (!on_tiles(ent, x0, y0, x1, y1))
+         continue;
+
+      memset(&slot->ents[count], 0, sizeof(heat_entity));
+      slot->ents[count].type = ent->type;
+      slot->ents[count].direction = ent->direction;
+      slot->ents[count].x = ent->x;
+      slot->ents[count].y = ent->y;
+      count++;
+   }
+
+   if (!slot->same_types)
+      for (int y=y0, i=0; y<y1; y++)
+         for (int x=x0; x<x1; x++, i++)
+            slot->planes[i] = tile_at(x,y).type;
+
+   queued = *fr;
+   queued_changes = pellet_changes;
+
+      /* both sides store then load, seq_cst, so one of them sees the other */
+   __atomic_store_n(&queue_tail, tail+1, __ATOMIC_SEQ_CST);
+
+   if (__atomic_load_n(&writer_asleep, __ATOMIC_SEQ_CST)){
+      SDL_LockMutex(heat_lock);
+      SDL_CondSignal(heat_wake);
+      SDL_UnlockMutex(heat_lock);
+   }
+
+   frames_captured++;
+   capture_usec += usec_now()-started;
+}
+
+   /* one frame's flood, all in the frame's tiles */
+struct heat_flood
+{
+   int w, h;
+   const int *types;
+   int *ent_vals;
+   int *seen;   /* the entity whose flood last got to a tile */
+   int *owner;   /* as Tile::last, -1 for none */
+   int *held;   /* entities holding it, as Tile::occupied */
+   int *queue;
+   int tail;
+};
+
+   /* as set_value */
+static void reach(heat_flood *f, int x, int y, int e, int value, bool override)
+{
+#ifdef FLOOD_HORIZON
+   if (value>FLOOD_HORIZON)
+      return;
+#endif
+
+   if (x<0 || x>=f->w || y<0 || y>=f->h)
+      return;
+
+   int i = y*f->w + x;
+
+   if (f->types[i]!='#' && (f->seen[i]!=e || value<f->ent_vals[i])
+      && (!f->held[i] || value>2 || override)){
+      f->seen[i] = e;
+      f->owner[i] = e;
+      f->ent_vals[i] = value;
+      f->queue[f->tail++] = i;
+   }
+}
+
+static int follow_of(char type, int distance)
+{
+   static int (* const follow[KINDS])(int) = {
+      kind_traits<KIND_ENEMY>::follow,
+      kind_traits<KIND_SNITCH>::follow,
+      kind_traits<KIND_PLAYER>::follow };
+
+   return follow[kind_of(type)](distance);
+}
+
+   /* the tvalue and ent_val planes update_boardvalues would leave on the
+      frame's tiles, from its types and entities. Entities off the tiles are
+      left out, and a way round that leaves them is not seen */
+static bool work_out_values(heat_slot *slot)
+{
+   heat_frame *fr = &slot->frame;
+   heat_flood f;
+   size_t tiles = (size_t)(fr->x1-fr->x0)*(fr->y1-fr->y0);
+   int *tvalues = slot->planes + tiles;
+   const heat_entity *ents = slot->ents;
+
+   if (!grow((void **)&flood_mem, &flood_room, tiles*4, sizeof(int)))
+      return false;
+
+   f.w = fr->x1-fr->x0;
+   f.h = fr->y1-fr->y0;
+   f.types = slot->planes;
+   f.ent_vals = tvalues + tiles;
+   f.seen = flood_mem;
+   f.owner = f.seen + tiles;
+   f.held = f.owner + tiles;
+   f.queue = f.held + tiles;
+
+   memset(tvalues, 0, 2*tiles*sizeof(int));
+   memset(f.seen, 0xFF, 2*tiles*sizeof(int));
+   memset(f.held, 0, tiles*sizeof(int));
+
+      /* as held_tile */
+   for (int e=0; e<fr->entities; e++)
+   {
+      int x = ents[e].x/16 + (ents[e].x%16!=0 && ents[e].direction==2) - fr->x0;
+      int y = ents[e].y/16 + (ents[e].y%16!=0 && ents[e].direction==1) - fr->y0;
+
+      if (x>=0 && x<f.w && y>=0 && y<f.h)
+         f.held[y*f.w + x]++;
+   }
+
+   for (int e=0; e<fr->entities; e++)
+   {
+      int x = ents[e].x/16 - fr->x0;
+      int y = ents[e].y/16 - fr->y0;
+
+      if (x<0 || x>=f.w || y<0 || y>=f.h)
+         continue;
+
+      int i = y*f.w + x;
+      f.seen[i] = f.owner[i] = e;
+      f.ent_vals[i] = 0;
+      f.tail = 0;
+
+      reach(&f, x, y-1, e, 1, true);
+      reach(&f, x-1, y, e, 1, true);
+      reach(&f, x+1, y, e, 1, true);
+      reach(&f, x, y+1, e, 1, true);
+
+      for (int head=0; head<f.tail; head++)
+      {
+         int at = f.queue[head];
+         int value = f.ent_vals[at]+1;
+
+         x = at%f.w;
+         y = at/f.w;
+         reach(&f, x, y-1, e, value, false);
+         reach(&f, x-1, y, e, value, false);
+         reach(&f, x+1, y, e, value, false);
+         reach(&f, x, y+1, e, value, false);
+      }
+
+         /* every tile an earlier flood got to counts again, like on the board */
+      for (size_t t=0; t<tiles; t++)
+      {
+         if (f.types[t]=='#' || f.owner[t]<0)
+            continue;
+
+         if (f.owner[t]==0)
+            tvalues[t] = 0;
+
+         tvalues[t] += follow_of(ents[f.owner[t]].type, f.ent_vals[t]);
+      }
+   }
+
+   return true;
+}
+
+   /* pack a frame against the one before and write it out */
+static bool write_frame(heat_slot *slot)
+{
+   heat_frame fr = slot->frame;
+   size_t tiles = (size_t)(fr.x1-fr.x0)*(fr.y1-fr.y0);
+   size_t values = tiles*HEAT_PLANES;
+
+   bool key = frames_written==0 || frames_written-last_key>=HEAT_KEY_EVERY
+      || fr.x0!=prev_frame.x0 || fr.y0!=prev_frame.y0 || fr.x1!=prev_frame.x1 || fr.y1!=prev_frame.y1;
+
+      /* at worst two 5 byte varints a value, and the padding */
+   if (!grow((void **)&packed, &packed_room, values*10+4, 1)
+      || !grow((void **)&prev, &prev_room, values, sizeof(int))
+      || !grow((void **)&frame_index, &index_room, frames_written+1, sizeof(uint64_t))){
+      printf("\nout of memory for heat frames\n");
+      return false;
+   }
+
+   if (slot->same_types)
+      memcpy(slot->planes, prev, tiles*sizeof(int));
+
+   if (!work_out_values(slot)){
+      printf("\nout of memory for heat frames\n");
+      return false;
+   }
+
+   size_t n = 0;
+   uint32_t same = 0;
+
+   for (size_t i=0; i<values; i++)
+   {
+      int32_t d = (int32_t)((uint32_t)slot->planes[i] - (key ? 0 : (uint32_t)prev[i]));
+
+      if (d==0){
+         same++;
+         continue;
+      }
+
+      n += put_varint(packed+n, same);
+      n += put_varint(packed+n, ((uint32_t)d << 1) ^ (uint32_t)(d >> 31));
+      same = 0;
+   }
+
+   fr.key = key;
+   fr.bytes = n;
+
+   while (n%4)
+      packed[n++] = 0;
+
+   if (fwrite(&fr, sizeof(fr), 1, out)!=1
+      || fwrite(slot->ents, sizeof(heat_entity), fr.entities, out)!=(size_t)fr.entities
+      || fwrite(packed, 1, n, out)!=n){
+      printf("\ncould not write a heat frame\n");
+      return false;
+   }
+
+   frame_index[frames_written] = out_at;
+   out_at += sizeof(fr) + fr.entities*sizeof(heat_entity) + n;
+
+   if (key)
+      last_key = frames_written;
+   frames_written++;
+
+   memcpy(prev, slot->planes, values*sizeof(int));
+   prev_frame = fr;
+
+   raw_bytes += sizeof(fr) + fr.entities*sizeof(heat_entity) + values*sizeof(int);
+
+   return true;
+}
+
+   /* the writer thread, until stop_heat and the queue is empty */
+static int write_heat(void *unused)
+{
+   bool ok = true;
+
+   for (;;)
+   {
+      unsigned int head = __atomic_load_n(&queue_head, __ATOMIC_RELAXED);
+
+      SDL_LockMutex(heat_lock);
+      __atomic_store_n(&writer_asleep, true, __ATOMIC_SEQ_CST);
+      while (head==__atomic_load_n(&queue_tail, __ATOMIC_SEQ_CST) && !stopping)
+         SDL_CondWait(heat_wake, heat_lock);
+      __atomic_store_n(&writer_asleep, false, __ATOMIC_RELAXED);
+      bool done = head==__atomic_load_n(&queue_tail, __ATOMIC_ACQUIRE);
+      SDL_UnlockMutex(heat_lock);
+
+      if (done)
+         break;
+
+      Uint64 started = usec_now();
+
+         /* a write that failed still takes the frame off, the game goes on */
+      if (ok)
+         ok = write_frame(&slots[head%HEAT_QUEUE]);
+
+      write_usec += usec_now()-started;
+
+      __atomic_store_n(&queue_head, head+1, __ATOMIC_RELEASE);
+   }
+
+   return ok;
+}
+
+int start_heat(const char *path)
+{
+   heat_header header;
+
+   if ((out = fopen(path, "wb"))==NULL){
+      printf("\ncould not write %s\n", path);
+      return 0;
+   }
+
+      /* no frames until stop_heat writes it again */
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, HEAT_MAGIC, 8);
+   header.planes = HEAT_PLANES;
+   header.key_every = HEAT_KEY_EVERY;
+
+   if (fwrite(&header, sizeof(header), 1, out)!=1){
+      printf("\ncould not write %s\n", path);
+      fclose(out);
+      out = NULL;
+      return 0;
+   }
+   out_at = sizeof(header);
+
+   memset(&queued, 0, sizeof(queued));   //no tiles, so the first frame copies its types
+
+   heat_lock = SDL_CreateMutex();
+   heat_wake = SDL_CreateCond();
+   stopping = false;
+
+   writer = SDL_CreateThread(write_heat, NULL);
+   heat_recording = writer!=NULL;
+
+   return heat_recording;
+}
+
+void stop_heat()
+{
+   if (writer==NULL)
+      return;
+
+   heat_recording = false;
+
+   SDL_LockMutex(heat_lock);
+   stopping = true;
+   SDL_CondSignal(heat_wake);
+   SDL_UnlockMutex(heat_lock);
+
+   int ok = 0;
+   SDL_WaitThread(writer, &ok);
+   writer = NULL;
+
+   heat_header header;
+   static const char zeros[8] = { 0 };
+
+      /* the index is 8 byte aligned, frames only come to 4 */
+   size_t pad = (8 - out_at%8) % 8;
+   if (ok && fwrite(zeros, 1, pad, out)!=pad)
+      ok = 0;
+   out_at += pad;
+
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, HEAT_MAGIC, 8);
+   header.planes = HEAT_PLANES;
+   header.key_every = HEAT_KEY_EVERY;
+   header.frames = frames_written;
+   header.index_offset = out_at;
+
+   if (!ok || fwrite(frame_index, sizeof(uint64_t), frames_written, out)!=(size_t)frames_written
+      || fseek(out, 0, SEEK_SET)!=0 || fwrite(&header, sizeof(header), 1, out)!=1)
+      printf("\ncould not finish the heat recording\n");
+
+   fclose(out);
+   out = NULL;
+
+   SDL_DestroyCond(heat_wake);
+   SDL_DestroyMutex(heat_lock);
+
+   for (int i=0; i<HEAT_QUEUE; i++){
+      free(slots[i].ents);
+      free(slots[i].planes);
+   }
+   memset(slots, 0, sizeof(slots));
+
+   free(frame_index);
+   free(prev);
+   free(packed);
+   free(flood_mem);
+   frame_index = NULL;
+   prev = NULL;
+   packed = NULL;
+   flood_mem = NULL;
+   index_room = prev_room = packed_room = flood_room = 0;
+}
+
+void print_heat_stats()
+{
+   if (frames_captured==0 && frames_dropped==0)
+      return;
+
+   printf("heat: %ld frames, %ld dropped, %.1f usec a frame to copy, %.1f to work out, pack and write, %.1f KB written (%.1f KB plain)\n",
+      frames_captured, frames_dropped, frames_captured ? (double)capture_usec/frames_captured : 0.0,
+      frames_written ? (double)write_usec/frames_written : 0.0, out_at/1024.0, raw_bytes/1024.0);
+}
+
+/* reading */
+
+static bool get_frame(int frame, heat_frame *fr, const char **data)
+{
+   if (heat_index[frame]+sizeof(heat_frame)>heat_map_size)
+      return false;
+
+   memcpy(fr, heat_map + heat_index[frame], sizeof(heat_frame));
+   *data = heat_map + heat_index[frame] + sizeof(heat_frame);
+
+   return fr->entities>=0 && fr->x1>fr->x0 && fr->y1>fr->y0
+      && (uint64_t)(fr->x1-fr->x0)*(fr->y1-fr->y0) < (1<<26)
+      && heat_index[frame]+sizeof(heat_frame)+(uint64_t)fr->entities*sizeof(heat_entity)+fr->bytes <= heat_map_size;
+}
+
+int open_heat(const char *path)
+{
+   struct stat st;
+   int fd = open(path, O_RDONLY);
+
+   if (fd==-1 || fstat(fd, &st)==-1 || (size_t)st.st_size<sizeof(heat_header)){
+      if (fd!=-1)
+         close(fd);
+      return 0;
+   }
+
+   heat_map = (char*) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+
+   if (heat_map==MAP_FAILED){
+      heat_map = NULL;
+      return 0;
+   }
+   heat_map_size = st.st_size;
+
+   memcpy(&heat_head, heat_map, sizeof(heat_head));
+
+   if (memcmp(heat_head.magic, HEAT_MAGIC, 8)!=0 || heat_head.planes!=HEAT_PLANES
+      || heat_head.frames>=(1u<<31) || heat_head.index_offset%8!=0
+      || heat_head.index_offset+heat_head.frames*sizeof(uint64_t)>heat_map_size){
+      close_heat();
+      return 0;
+   }
+
+   heat_index = (const uint64_t*) (heat_map + heat_head.index_offset);
+
+   return heat_head.frames;
+}
+
+int read_heat(int frame, heat_view *view)
+{
+   heat_frame fr;
+   const char *data;
+   int key = frame;
+
+   if (heat_map==NULL || frame<0 || (uint64_t)frame>=heat_head.frames)
+      return 0;
+
+      /* back to the whole frame this one builds on */
+   while (key>0 && get_frame(key, &fr, &data) && !fr.key)
+      key--;
+
+   for (int at=key; at<=frame; at++)
+   {
+      if (!get_frame(at, &fr, &data))
+         return 0;
+
+      size_t tiles = (size_t)(fr.x1-fr.x0)*(fr.y1-fr.y0);
+      size_t values = tiles*HEAT_PLANES;
+      size_t room = view->room;
+
+      if (at==key && !fr.key)
+         return 0;
+      if (!fr.key && (fr.x0!=view->x0 || fr.y0!=view->y0 || fr.x1!=view->x1 || fr.y1!=view->y1))
+         return 0;
+      if (!grow((void **)&view->planes, &room, values, sizeof(int)))
+         return 0;
+      view->room = room;
+
+      if (fr.key)
+         memset(view->planes, 0, values*sizeof(int));
+
+      const unsigned char *p = (const unsigned char *) data + fr.entities*sizeof(heat_entity);
+      const unsigned char *end = p + fr.bytes;
+      size_t i = 0;
+
+      while (p<end)
+      {
+         uint32_t same, d;
+
+         if ((p = get_varint(p, end, &same))==NULL || (p = get_varint(p, end, &d))==NULL)
+            return 0;
+
+         i += same;
+         if (i>=values)
+            break;
+
+         view->planes[i++] += (int)((d >> 1) ^ -(d & 1));
+      }
+
+      view->tick = fr.tick;
+      view->packets = fr.packets;
+      view->losses = fr.losses;
+      view->x0 = fr.x0;
+      view->y0 = fr.y0;
+      view->x1 = fr.x1;
+      view->y1 = fr.y1;
+      view->types = view->planes;
+      view->tvalues = view->planes + tiles;
+      view->ent_vals = view->planes + 2*tiles;
+      view->count = fr.entities;
+      view->ents = (const heat_entity *) data;
+   }
+
+   return 1;
+}
+
+void close_heat()
+{
+   if (heat_map!=NULL)
+      munmap(heat_map, heat_map_size);
+
+   heat_map = NULL;
+   heat_map_size = 0;
+   heat_index = NULL;
+}
+
+   /* a map of a frame's heat, hottest 9 */
+static void print_frame(int frame, heat_view *view)
+{
+   int w = view->x1-view->x0;
+   int hottest = 1;
+
+   printf("frame %d: tick %d, %d packets left, %d losses, tiles %d,%d to %d,%d\n", frame,
+      view->tick, view->packets, view->losses, view->x0, view->y0, view->x1, view->y1);
+
+   for (int i=0; i<view->count; i++)
+      printf("  %c at %d,%d going %d\n", view->ents[i].type, view->ents[i].x, view->ents[i].y, view->ents[i].direction);
+
+   for (int i=0; i<w*(view->y1-view->y0); i++)
+      if (view->types[i]!='#')
+         hottest = std::max(hottest, view->tvalues[i]);
+
+   for (int y=view->y0; y<view->y1; y++)
+   {
+      for (int x=view->x0; x<view->x1; x++)
+      {
+         int i = (y-view->y0)*w + (x-view->x0);
+         char c = view->types[i]=='#' ? '#' : view->tvalues[i]>0 ? '0' + (int)(9LL*view->tvalues[i]/hottest) : '.';
+
+         for (int e=0; e<view->count; e++)
+            if (view->ents[e].x/16==x && view->ents[e].y/16==y)
+               c = view->ents[e].type;
+
+         putchar(c);
+      }
+      putchar('\n');
+   }
+}
+
+int show_heat(const char *path, int frame)
+{
+   int frames = open_heat(path);
+   heat_view view;
+
+   if (frames==0){
+      printf("\n%s is not a heat recording, or one that was never finished\n", path);
+      return 0;
+   }
+
+   memset(&view, 0, sizeof(view));
+
+   if (frame>=0){
+      if (!read_heat(frame, &view)){
+         printf("\nno frame %d in %s, it has %d\n", frame, path, frames);
+         close_heat();
+         return 0;
+      }
+      print_frame(frame, &view);
+   }
+   else{
+      heat_frame fr;
+      const char *data;
+      int keys = 0;
+
+      for (int i=0; i<frames; i++)
+         if (get_frame(i, &fr, &data) && fr.key)
+            keys++;
+
+      printf("%s: %d frames, %d of them whole, %.1f KB, %.1f bytes a frame\n", path, frames, keys,
+         heat_map_size/1024.0, (double)heat_map_size/frames);
+   }
+
+   free(view.planes);
+   close_heat();
+
+   return 1;
+}
@@ -0,0 +1,74 @@
+#ifndef HEAT_H
+#define HEAT_H
+
+#include <stdint.h>
+
+#include "packman.h"
+
+/*
+ *  Recording the AI's fields, to look at after the game.
+ *
+ *  With heat=<file> every snapshot also puts the tile types and entities of
+ *  the tiles it covers onto a queue. A writer thread of its own works out
+ *  the path values (tvalue) and distances (ent_val) on those tiles and packs
+ *  it all into the file, so the simulation only pays for the copy. The
+ *  writer's floods never leave the tiles covered, so where the shortest way
+ *  goes off them its distances are longer than the game's. If the writer
+ *  falls HEAT_QUEUE frames behind, frames are dropped rather than holding up
+ *  the game.
+ *
+ *  A frame is stored as the difference from the one before, every
+ *  HEAT_KEY_EVERY frames and whenever the tiles covered move it is stored
+ *  whole. Either way only the values that are not 0 take up room. An index
+ *  at the end of the file has where every frame starts, so a reader maps the
+ *  file and decodes any frame from at most HEAT_KEY_EVERY-1 frames before it.
+ *  'Packman heat <file> [frame]' prints what is in one.
+ */
+
+   /* frames copied and waiting for the writer */
+#define HEAT_QUEUE 16
+   /* a whole frame every this many */
+#define HEAT_KEY_EVERY 32
+   /* types, tvalue and ent_val, one after another */
+#define HEAT_PLANES 3
+
+struct heat_entity
+{
+   char type;
+   char direction;
+   char pad[2];
+   int32_t x;
+   int32_t y;
+};
+
+struct heat_view
+{
+   int tick;   /* sim ticks into its level */
+   int packets;
+   int losses;
+
+   int x0, y0, x1, y1;   /* the tiles, [x0,x1) x [y0,y1) */
+   int *types;
+   int *tvalues;
+   int *ent_vals;
+
+   int count;
+   const heat_entity *ents;   /* straight from the mapped file */
+
+   int *planes;   /* decoded, the three above point into it */
+   int room;
+};
+
+extern bool heat_recording;
+
+int start_heat(const char *path);   /* start writing frames to path, returns 1 on success */
+void heat_capture(unsigned int tick, int x0, int y0, int x1, int y1);   /* simulation side: queue a frame of tiles [x0,x1) x [y0,y1) */
+void stop_heat();   /* let the writer finish and write the index */
+void print_heat_stats();
+
+int open_heat(const char *path);   /* map a recording, returns its frame count, 0 if it is no good */
+int read_heat(int frame, heat_view *view);   /* decode a frame into view, returns 1 on success */
+void close_heat();
+int show_heat(const char *path, int frame);   /* print a recording, one frame of it for frame>=0 */
+
+#endif
@@ -0,0 +1,147 @@
+/*
+ * Input queue, see input.h.
+ *
+ *   A ring with one writer and one reader: the main thread only moves
+ *   queue_tail and the simulation thread only moves queue_head, so both are
+ *   plain atomics and neither side waits.
+ */
+
+#include <string.h>
+#include <algorithm>
+
+#include "input.h"
+
+struct key_event
+{
+   Uint64 at;   /* usec_now when it was polled */
+   char dir;
+   bool down;
+};
+
+static key_event queue[INPUT_QUEUE];
+static unsigned int queue_head = 0;
+static unsigned int queue_tail = 0;
+
+bool input_held[5];
+int next_turn = 0;
+
+   /* when each direction was last pressed, 0 once the player has turned that way */
+static Uint64 pressed_at[5];
+
+   /* for print_input_stats */
+#define LATENCY_BUCKETS 256   /* whole ms, the last one is everything longer */
+static long turn_latency[LATENCY_BUCKETS];
+static long turns = 0;
+static Uint64 latency_max = 0;
+static long keys = 0;
+static long keys_dropped = 0;
+static Uint64 queued_total = 0;
+static Uint64 queued_max = 0;
+
+int key_dir(SDLKey key)
+{
+   switch (key)
+   {
+      case SDLK_UP: return 1;
+      case SDLK_LEFT: return 2;
+      case SDLK_RIGHT: return 3;
+      case SDLK_DOWN: return 4;
+      default: return 0;
+   }
+}
+
+void push_input(int dir, bool down)
+{
+   unsigned int tail = __atomic_load_n(&queue_tail, __ATOMIC_RELAXED);
+
+   if (tail - __atomic_load_n(&queue_head, __ATOMIC_ACQUIRE) >= INPUT_QUEUE){
+      keys_dropped++;
+      return;
+   }
+
+   queue[tail%INPUT_QUEUE].at = usec_now();
+   queue[tail%INPUT_QUEUE].dir = dir;
+   queue[tail%INPUT_QUEUE].down = down;
+
+   __atomic_store_n(&queue_tail, tail+1, __ATOMIC_RELEASE);
+}
+
+void drain_input()
+{
+   unsigned int head = __atomic_load_n(&queue_head, __ATOMIC_RELAXED);
+   unsigned int tail = __atomic_load_n(&queue_tail, __ATOMIC_ACQUIRE);
+
+   if (head==tail)
+      return;
+
+   Uint64 now = usec_now();
+
+   for (; head!=tail; head++)
+   {
+      key_event *ev = &queue[head%INPUT_QUEUE];
+
+      input_held[(int)ev->dir] = ev->down;
+      if (ev->down){
+         next_turn = ev->dir;
+         pressed_at[(int)ev->dir] = ev->at;
+      }
+
+      keys++;
+      queued_total += now-ev->at;
+      queued_max = std::max(queued_max, now-ev->at);
+   }
+
+   __atomic_store_n(&queue_head, head, __ATOMIC_RELEASE);
+}
+
+void turn_taken(int dir)
+{
+   if (next_turn==dir)
+      next_turn = 0;
+
+   if (pressed_at[dir]==0)
+      return;
+
+   Uint64 latency = usec_now()-pressed_at[dir];
+   pressed_at[dir] = 0;
+
+   turns++;
+   turn_latency[std::min(latency/1000, (Uint64)LATENCY_BUCKETS-1)]++;
+   latency_max = std::max(latency_max, latency);
+}
+
+void reset_input()
+{
+   __atomic_store_n(&queue_head, __atomic_load_n(&queue_tail, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+
+   memset(input_held, 0, sizeof(input_held));
+   memset(pressed_at, 0, sizeof(pressed_at));
+   next_turn = 0;
+}
+
+   /* ms under which a fraction of the turns came */
+static int latency_percentile(double fraction)
+{
+   long seen = 0;
+
+   for (int ms=0; ms<LATENCY_BUCKETS; ms++){
+      seen += turn_latency[ms];
+      if (seen>=fraction*turns)
+         return ms;
+   }
+
+   return LATENCY_BUCKETS-1;
+}
+
+void print_input_stats()
+{
+   if (keys==0)
+      return;
+
+   printf("input: %ld keys (%ld dropped), queued %.2f ms average %.2f ms max\n",
+      keys, keys_dropped, queued_total/1000.0/keys, queued_max/1000.0);
+
+   if (turns)
+      printf("input: %ld turns, key to turn %d ms p50 %d ms p99 %.1f ms max\n",
+         turns, latency_percentile(0.5), latency_percentile(0.99), latency_max/1000.0);
+}
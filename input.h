@@ -0,0 +1,31 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include "packman.h"
+
+/*
+ *  Arrow keys, from the event loop to the player.
+ *
+ *  The main thread stamps every arrow key press and release as it polls it and
+ *  puts it on a queue. The simulation thread drains the queue every tick into
+ *  input_held[], and the last key pressed is kept as the next turn until the
+ *  player reaches a tile where it can take it. A tap between tiles still turns
+ *  the player at the next junction that way, however short it was.
+ *
+ *  Directions are numbered like entity directions, 1 up 2 left 3 right 4 down.
+ */
+
+   /* presses and releases not yet drained, more than this and the newest are dropped */
+#define INPUT_QUEUE 64
+
+extern bool input_held[5];   /* simulation side: arrow keys down as of the last drain */
+extern int next_turn;   /* simulation side: buffered direction, 0 for none */
+
+int key_dir(SDLKey key);   /* direction for an arrow key, 0 for any other key */
+void push_input(int dir, bool down);   /* main thread: an arrow key press or release, just polled */
+void drain_input();   /* simulation side: take everything queued, once a tick */
+void turn_taken(int dir);   /* simulation side: the player just set off towards dir */
+void reset_input();   /* new level, only while the simulation is stopped */
+void print_input_stats();
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef KINDS_H
+#define KINDS_H
+
+#include <algorithm>
+
+#include "packman.h"
+
+/*
+ *  Entity kinds as compile time policies.
+ *
+ *  Everything that used to be an `if (ent->type=='E')` in the tick lives in
+ *  kind_traits<> and kind_contact[][] instead. The movement, steering and
+ *  interaction code in packman.cpp is templated on the kind, and every kind
+ *  has its own batch of entities, so a tick is one tight loop per kind with
+ *  the kind's rules folded in by the compiler.
+ *
+ *  To add a kind (say a powered up player): add it to entity_kind, give it a
+ *  kind_traits<> specialization, fill in its row and column of kind_contact,
+ *  map its level character in kind_of(), and add its batch to move_entities()
+ *  and its pairs to collide().
+ *
+ *  Kinds are ticked in enum order. Every level we ship lists its enemies
+ *  first, then the snitch, then the player, so this is the old order too.
+ */
+enum entity_kind { KIND_ENEMY, KIND_SNITCH, KIND_PLAYER, KINDS };
+
+   /* how a kind picks its direction on a tile */
+enum { STEER_KEYS, STEER_CHASE, STEER_FLEE };
+
+   /* what happens when two kinds end up on the same tile */
+enum { CONTACT_NONE, CONTACT_DEATH, CONTACT_WIN };
+
+template<int KIND> struct kind_traits;
+
+template<> struct kind_traits<KIND_ENEMY>
+{
+   static const char type = 'E';
+   static const int speed = 1;   /* pixels per 20ms tick */
+   static const int steering = STEER_CHASE;
+   static const bool eats_packets = false;
+      /* tiles away (straight across, not walking) past which its pull is not
+         worth a flood, 0 for never flooded, -1 for flooded from anywhere */
+   static const int reach = 40;
+
+      /* what a tile distance away from an enemy is worth to the others */
+   static int follow(int distance) {
+      return -6000000/(std::max(distance,1)*std::max(distance,1)); }
+};
+
+template<> struct kind_traits<KIND_SNITCH>
+{
+   static const char type = '*';
+   static const int speed = 1;
+   static const int steering = STEER_FLEE;
+   static const bool eats_packets = false;
+   static const int reach = 0;
+
+   static int follow(int distance) { return 0; }
+};
+
+template<> struct kind_traits<KIND_PLAYER>
+{
+   static const char type = 'P';
+   static const int speed = 2;
+   static const int steering = STEER_KEYS;
+   static const bool eats_packets = true;
+   static const int reach = -1;
+
+   static int follow(int distance) { return 15000000/std::max(distance,1); }
+};
+
+   /* what happens when an a and a b touch, kind_contact[a][b]. keep it symmetric,
+      collide() only looks at each pair of kinds once */
+static const char kind_contact[KINDS][KINDS] =
+{
+               /* enemy           snitch        player */
+   /* enemy  */ { CONTACT_NONE,  CONTACT_NONE, CONTACT_DEATH },
+   /* snitch */ { CONTACT_NONE,  CONTACT_NONE, CONTACT_WIN   },
+   /* player */ { CONTACT_DEATH, CONTACT_WIN,  CONTACT_NONE  },
+};
+
+   /* level character to kind, unknown characters become snitches like they always did */
+static inline int kind_of(char type)
+{
+   if (type==kind_traits<KIND_ENEMY>::type)
+      return KIND_ENEMY;
+   if (type==kind_traits<KIND_PLAYER>::type)
+      return KIND_PLAYER;
+   return KIND_SNITCH;
+}
+
+/* per kind batches of entity_list, in list order. defined in packman.cpp */
+extern entity **kind_batch[KINDS];
+extern int kind_count[KINDS];
+
+#endif
@@ -0,0 +1,144 @@
+/*
+ * Random maze levels, for benchmarks and for testing very large maps.
+ *
+ *   Cells sit on odd coordinates and are carved out with an iterative
+ *   depth-first backtracker, then some walls between corridors are knocked
+ *   out so the maze has loops and junctions for the enemies to pick from.
+ */
+
+#include <stdlib.h>
+
+#include "levelgen.h"
+
+static unsigned int next_rand(unsigned int *state)
+{
+   /* xorshift32, so mazes don't depend on the libc rand() */
+   unsigned int x = *state;
+   x ^= x << 13;
+   x ^= x >> 17;
+   x ^= x << 5;
+   *state = x;
+   return x;
+}
+
+int gen_maze(FILE *out, int w, int h, unsigned int seed, int enemies)
+{
+   if (w<5 || h<5)
+      return 0;
+
+   char *grid = (char*) malloc((size_t)w*h);
+   int *stack = (int*) malloc((size_t)w*h*sizeof(int));
+   unsigned int state = seed ? seed : 1;
+
+   if (grid==NULL || stack==NULL){
+      free(grid);
+      free(stack);
+      return 0;
+   }
+
+   for (int i=0; i<w*h; i++)
+      grid[i] = '#';
+
+      /* last usable odd coordinate */
+   int maxx = (w-2) - ((w-2)%2==0);
+   int maxy = (h-2) - ((h-2)%2==0);
+
+   int top = 0;
+   stack[top++] = 1*w + 1;
+   grid[1*w + 1] = 'o';
+
+   while (top>0)
+   {
+      int cell = stack[top-1];
+      int x = cell%w;
+      int y = cell/w;
+
+      int dirs[4];
+      int ndirs = 0;
+
+      if (y-2>=1 && grid[(y-2)*w+x]=='#')
+         dirs[ndirs++] = 1;
+      if (x-2>=1 && grid[y*w+x-2]=='#')
+         dirs[ndirs++] = 2;
+      if (x+2<=maxx && grid[y*w+x+2]=='#')
+         dirs[ndirs++] = 3;
+      if (y+2<=maxy && grid[(y+2)*w+x]=='#')
+         dirs[ndirs++] = 4;
+
+      if (ndirs==0){
+         top--;
+         continue;
+      }
+
+      int dx=0, dy=0;
+      switch (dirs[next_rand(&state)%ndirs])
+      {
+         case 1: dy=-1; break;
+         case 2: dx=-1; break;
+         case 3: dx=1; break;
+         case 4: dy=1; break;
+      }
+
+      grid[(y+dy)*w + x+dx] = 'o';
+      grid[(y+2*dy)*w + x+2*dx] = 'o';
+      stack[top++] = (y+2*dy)*w + x+2*dx;
+   }
+
+      /* knock out about one in eight of the walls between two corridors */
+   for (int y=1; y<h-1; y++)
+   {
+      for (int x=1; x<w-1; x++)
+      {
+         if (grid[y*w+x]!='#' || next_rand(&state)%8!=0)
+            continue;
+         if ((grid[y*w+x-1]!='#' && grid[y*w+x+1]!='#' && grid[(y-1)*w+x]=='#' && grid[(y+1)*w+x]=='#')
+            || (grid[(y-1)*w+x]!='#' && grid[(y+1)*w+x]!='#' && grid[y*w+x-1]=='#' && grid[y*w+x+1]=='#'))
+            grid[y*w+x] = 'o';
+      }
+   }
+
+   grid[1*w + 1] = 'P';
+
+      /* enemies go on random cells away from the player's corner */
+   for (int i=0; i<enemies; i++)
+   {
+      for (int tries=0; tries<64; tries++)
+      {
+         int x = 1 + 2*(next_rand(&state)%((maxx+1)/2));
+         int y = 1 + 2*(next_rand(&state)%((maxy+1)/2));
+
+         if (grid[y*w+x]=='o' && x+y>8){
+            grid[y*w+x] = 'E';
+            break;
+         }
+      }
+   }
+
+   fprintf(out, "%dx%d\n", w, h);
+   for (int y=0; y<h; y++)
+   {
+      fwrite(grid + (size_t)y*w, 1, w, out);
+      if (y!=h-1)
+         fputc('\n', out);
+   }
+
+   free(grid);
+   free(stack);
+
+   return 1;
+}
+
+int gen_maze_file(const char *path, int w, int h, unsigned int seed, int enemies)
+{
+   FILE *out = fopen(path, "w");
+
+   if (out==NULL)
+      return 0;
+
+   int ok = gen_maze(out, w, h, seed, enemies);
+
+   if (fclose(out)!=0)
+      return 0;
+
+   return ok;
+}
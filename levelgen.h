@@ -0,0 +1,13 @@
+#ifndef LEVELGEN_H
+#define LEVELGEN_H
+
+#include <stdio.h>
+
+   /* write a random w x h maze in the level file format, with loops, pellets,
+      a player and `enemies` enemies. Same seed gives the same maze */
+int gen_maze(FILE *out, int w, int h, unsigned int seed, int enemies);
+
+   /* gen_maze into the file at path */
+int gen_maze_file(const char *path, int w, int h, unsigned int seed, int enemies);
+
+#endif
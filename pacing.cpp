@@ -0,0 +1,97 @@
+/*
+ * Frame pacing, see pacing.h.
+ *
+ *   Frame cost is the time from the start of a frame to it being presented,
+ *   frame time is start to start. Both go into histograms of tenths of a ms
+ *   for print_frame_stats.
+ */
+
+#include <unistd.h>
+#include <algorithm>
+
+#include "pacing.h"
+
+unsigned int target_fps = 60;
+
+static Uint64 frame_start = 0;
+static Uint64 frame_due = 0;   /* when the next frame starts */
+static Uint64 wake_late = 0;   /* average of how late sleeps wake, in usec */
+
+   /* for print_frame_stats */
+#define FRAME_BUCKETS 1000   /* tenths of a ms, the last one is everything longer */
+static long frame_cost[FRAME_BUCKETS];
+static long frame_time[FRAME_BUCKETS];
+static long frames = 0;
+static long frames_late = 0;   /* ran past when the next one was due */
+static Uint64 cost_max = 0;
+static Uint64 time_max = 0;
+
+static void count(long *hist, Uint64 usec)
+{
+   hist[std::min(usec/100, (Uint64)FRAME_BUCKETS-1)]++;
+}
+
+void start_frames()
+{
+   frame_start = frame_due = usec_now();
+}
+
+void end_frame()
+{
+   Uint64 now = usec_now();
+   Uint64 cost = now - frame_start;
+
+   count(frame_cost, cost);
+   cost_max = std::max(cost_max, cost);
+
+   if (target_fps){
+      frame_due += 1000000/target_fps;
+
+      if (now >= frame_due){
+         frames_late++;
+         frame_due = now;
+      }
+      else if (frame_due - now > wake_late){
+         usleep(frame_due - now - wake_late);
+
+            /* how late this wake was, from where it was aimed */
+         Uint64 woke = usec_now();
+         Uint64 late = woke + wake_late > frame_due ? woke + wake_late - frame_due : 0;
+         wake_late = (wake_late*7 + late)/8;
+      }
+   }
+
+   now = usec_now();
+
+   count(frame_time, now - frame_start);
+   time_max = std::max(time_max, now - frame_start);
+   frames++;
+
+   frame_start = now;
+}
+
+   /* ms under which a fraction of the frames came */
+static double percentile(long *hist, double fraction)
+{
+   long seen = 0;
+
+   for (int i=0; i<FRAME_BUCKETS; i++){
+      seen += hist[i];
+      if (seen>=fraction*frames)
+         return (i+1)/10.0;
+   }
+
+   return FRAME_BUCKETS/10.0;
+}
+
+void print_frame_stats()
+{
+   if (frames==0)
+      return;
+
+   printf("frames: %ld at %u fps target, %ld late\n", frames, target_fps, frames_late);
+   printf("frames: time p50 %.1f p95 %.1f p99 %.1f max %.1f ms\n",
+      percentile(frame_time, 0.5), percentile(frame_time, 0.95), percentile(frame_time, 0.99), time_max/1000.0);
+   printf("frames: cost p50 %.1f p95 %.1f p99 %.1f max %.1f ms\n",
+      percentile(frame_cost, 0.5), percentile(frame_cost, 0.95), percentile(frame_cost, 0.99), cost_max/1000.0);
+}
@@ -0,0 +1,23 @@
+#ifndef PACING_H
+#define PACING_H
+
+#include "packman.h"
+
+/*
+ *  Frame pacing for the render loop.
+ *
+ *  Frames are due every 1/target_fps seconds. After presenting a frame the
+ *  loop sleeps only what is left until the next one is due, less however late
+ *  sleeps have been waking up lately. A frame that runs over its slot starts
+ *  the next one straight away and the schedule starts again from there, so a
+ *  slow frame never turns into a burst of catch-up frames.
+ */
+
+   /* frames a second to aim for, 0 to draw as fast as it goes */
+extern unsigned int target_fps;
+
+void start_frames();   /* before the first frame, and after anything else held up the loop */
+void end_frame();   /* after presenting: time the frame and sleep off the rest of its slot */
+void print_frame_stats();
+
+#endif
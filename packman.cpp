@@ -21,75 +21,130 @@
  */
 
 #include <unistd.h>
-
-#include "boilerplate.h"
-
-#define PLAYER_SPEED 2
-#define ENEMY_SPEED 1
-#define SNITCH_SPEED 1
+#include <string.h>
+#include <time.h>
+#include <ctype.h>
+
+#include "packman.h"
+#include "viewport.h"
+#include "levelgen.h"
+#include "kinds.h"
+#include "search.h"
+#include "snapshot.h"
+#include "input.h"
+#include "pacing.h"
+#include "blit.h"
+#include "rewind.h"
+#include "arena.h"
+#include "heat.h"
+#include "server.h"
+#include "assets.h"
+#include "bot.h"
+#include "pellets.h"
+#include "SDL/SDL_thread.h"
 
 int deaths_to_lose = 3;
 
 /* graphics */
-SDL_Surface *background = NULL;
 SDL_Surface *player_image;
 SDL_Surface *enemy_image;
 SDL_Surface *snitch_image;
 SDL_Surface *packet;
 SDL_Surface *powered_player_image;
-TTF_Font *font = NULL;
 SDL_Color textColor = { 255, 255, 255 };
 SDL_Color poweredColor = {0, 255, 255};
 SDL_Surface *redtile = NULL;
 SDL_Surface *bluetile = NULL;
 
-struct Tile
-{
-   char type;
+extern SDL_Event event;
 
-      /* for enemy AI */
-   int ent_val;
-      /* the last enemy that looked at the tile */
-   struct entity *last;
-      /* the total value for a square */
-   int tvalue;
+/* level stuff */
+int width;
+int height;
+int field_stride;
 
-   bool occupied;
-};
+struct entity *entity_list = NULL;
+struct entity *last_entity = NULL;   /* the end of entity_list, for new_entity */
+struct entity *player = NULL;
+
+Tile* game_field = NULL;
 
+   /* entity_list split up by kind, see kinds.h */
+entity **kind_batch[KINDS];
+int kind_count[KINDS];
+int kind_room[KINDS];
 
-   /* linked list of entities */
-struct entity
+   /* one corner of the path an entity took this tick, t is how far into the tick */
+struct sweep_point
 {
-   char type;
-
    int x;
    int y;
+   float t;
+};
 
-   int origx;
-   int origy;
+   /* every entity's path this tick, see entity::sweep */
+sweep_point *sweep_points = NULL;
+int sweep_count = 0;
+int sweep_room = 0;
 
-   char direction;
+   /* entities waiting for a turn to think, see schedule_ai */
+struct ai_wait
+{
+   int dist;
+   int due;   /* ticks before it gets to its junction, 0 for this one */
+   int x, y;   /* the junction */
+   entity *ent;
+};
 
-   SDL_Surface *image;
+ai_wait *ai_queue = NULL;
+int ai_room = 0;
+unsigned int ai_tick = 0;
+long ai_decisions = 0;
+long ai_reused = 0;
+long ai_planned = 0;
+long ai_missed = 0;
+
+   /* the simulation thread, see simulate() */
+SDL_Thread *sim_thread = NULL;
+int sim_stop = 0;   /* set by the render thread to stop it */
+int sim_done = 0;   /* set by the simulation thread when it stops */
+unsigned int sim_ticks = 0;
+int rewind_wanted = 0;   /* ticks the render thread asked to go back, REWIND_ALL for the level start */
+Uint32 died_at = 0;   /* SDL_GetTicks of the last death this level */
+
+   /* tiles waiting to be expanded by flood_distances */
+int *flood_queue = NULL;
+int flood_tail = 0;
+   /* counts flood_distances runs, so a flood never trusts values from an older one */
+unsigned int flood_count = 0;
 
-   struct entity *next;
-};
 
-extern SDL_Surface *screen;
-extern SDL_Event event;
+/* other stuff */
+#define INT_MAX 2147483647
 
-/* level stuff */
-int width;
-int height;
+   /* most 20ms ticks simulated in one go */
+#define MAX_CATCHUP 5
 
-struct entity *entity_list = NULL;
+   /* ticks backspace goes back, and what 'r' asks for */
+#define REWIND_STEP 100
+#define REWIND_ALL -1
 
-Tile* game_field = NULL;
+   /* ms the simulation sits out after a death, with the banner up */
+#define DEATH_PAUSE 3000
 
+   /* pixels apart on both axes that count as running into each other */
+#define CONTACT_RADIUS 12
 
-/* other stuff */
-#define INT_MAX 2147483647
+   /* full calc_path decisions allowed in one tick, closest to the player first */
+#define AI_BUDGET 8
+   /* near entities ask for a decision from this many ticks before they get to
+      a junction, so more than AI_BUDGET of them getting there in one tick can
+      be decided in the ticks before */
+#define AI_LEAD 16
+   /* further than this many tiles from the player an enemy only gets a turn
+      every AI_STAGGER ticks, and keeps going its old way in between */
+#define AI_NEAR 40
+#define AI_STAGGER 8
 
 int previous_dir=0;
 
@@ -100,18 +155,25 @@ int level = 0;
 bool renderpaths = false;
 
 /* function prototypes */
-int interact(entity *ent);
-void set_value(int tilex, int tiley, entity *ent, int value, int override);
 int follow_value(entity *ent_ptr, int distance);
-int update_boardvalues();
-int cleanuplvl();
 int winlvl();
 
 
     //release all held data
 void clean_up()
 {
+   print_chunk_stats();
+   print_input_stats();
+   print_frame_stats();
+   print_rewind_stats();
+   print_bot_stats();
+   stop_heat();
+   print_heat_stats();
    cleanuplvl();
+   print_arena_stats();
+   free_level_arena();
+   free_snapshots();
+   free_blits();
 
    SDL_FreeSurface(redtile);
    SDL_FreeSurface(bluetile);
@@ -119,8 +181,9 @@ void clean_up()
    SDL_FreeSurface(player_image);
    SDL_FreeSurface(enemy_image);
    SDL_FreeSurface(snitch_image);
+   SDL_FreeSurface(powered_player_image);
    SDL_FreeSurface(screen);
-   TTF_CloseFont( font );
+   close_assets();
     
    SDL_Quit();
 }
@@ -133,14 +196,21 @@ void clean_up()
  //load relevant files
 bool load_files()
 {
-    font = TTF_OpenFont("assets/arial.ttf",18); //font
+      /* without a pack images are decoded and text drawn with SDL_ttf like before */
+    open_assets();
 
     if ((packet = load_image("assets/packet.png"))==NULL){
        printf("Could not find 'assets/packet.png'");
        return false;
     }
 
-    if (!font){
+      /* entity sprites, the same for every level */
+   enemy_image = render_text( "E", textColor );
+   player_image = render_text( "P", textColor );
+   powered_player_image = render_text( "P", poweredColor);
+   snitch_image = render_text( "*", textColor );
+
+    if (enemy_image==NULL || player_image==NULL || powered_player_image==NULL || snitch_image==NULL){
         printf("\nCould not find font\n");
         return false;
     }
@@ -159,49 +229,137 @@ bool load_files()
  /* put in a new entity and return it */
 struct entity* new_entity()
 {
+   entity *new_ent = (entity *) level_alloc(sizeof(entity));
 
    /* if list is empty */
    if (entity_list == NULL)
-   {
-      entity_list = (entity *) calloc(1, sizeof(entity));
-      return entity_list;
-   }
+      entity_list = new_ent;
+   else
+      last_entity->next = new_ent;
 
-      /* find the end */
-   entity *ent_ptr = entity_list;
+   last_entity = new_ent;
+
+   return new_ent;
+}
 
-   while (ent_ptr->next!=NULL)
-      ent_ptr = ent_ptr->next;
 
-   ent_ptr->next = (entity *) calloc(1, sizeof(entity));
+const char *tile_layout_name()
+{
+#if TILE_LAYOUT == TILE_CHUNKED
+   return "chunked";
+#elif TILE_LAYOUT == TILE_BLOCKED
+   return "blocked";
+#elif TILE_LAYOUT == TILE_MORTON
+   return "morton";
+#else
+   return "row-major";
+#endif
+}
 
-   return ent_ptr->next;
+#if TILE_LAYOUT != TILE_CHUNKED
+   /* allocate a zeroed game field big enough for the compiled layout */
+Tile *alloc_field(int w, int h)
+{
+   size_t size;
+
+   width = w;
+   height = h;
+
+#if TILE_LAYOUT == TILE_BLOCKED
+   field_stride = (w+TILE_BLOCK-1)/TILE_BLOCK;
+   size = (size_t)field_stride*((h+TILE_BLOCK-1)/TILE_BLOCK)*TILE_BLOCK*TILE_BLOCK;
+#elif TILE_LAYOUT == TILE_MORTON
+   int side = 1;
+   while (side<w || side<h)
+      side*=2;
+   size = (size_t)side*side;
+#else
+   size = (size_t)w*h;
+#endif
+
+   game_field = (Tile*) level_alloc(size*sizeof(Tile));
+   flood_queue = (int*) level_alloc((size_t)w*h*sizeof(int));
+
+   return game_field;
 }
 
+#endif
+
+void free_field()
+{
+#if TILE_LAYOUT == TILE_CHUNKED
+   close_chunked_level();
+#endif
+   game_field = NULL;
+   flood_queue = NULL;
+}
+
+   /* add an entity of type 'P', 'E' or '*' standing on tile x,y */
+struct entity* spawn_entity(char type, int x, int y)
+{
+   entity *new_ent = new_entity();
+
+   new_ent->type = type;
+   new_ent->kind = kind_of(type);
+   new_ent->x = new_ent->origx = x*16;
+   new_ent->y = new_ent->origy = y*16;
+   new_ent->prev_x = new_ent->x;
+   new_ent->prev_y = new_ent->y;
+
+   if (type=='P'){
+      new_ent->image = player_image;
+      player = new_ent;
+   }
+   else if (type=='E')
+      new_ent->image = enemy_image;
+   else
+      new_ent->image = snitch_image;
+
+   int kind = new_ent->kind;
+
+   if (kind_count[kind]==kind_room[kind]){
+      kind_batch[kind] = (entity **) level_grow(kind_batch[kind], kind_room[kind]*sizeof(entity *),
+         (kind_room[kind] ? kind_room[kind]*2 : 16)*sizeof(entity *));
+      kind_room[kind] = kind_room[kind] ? kind_room[kind]*2 : 16;
+   }
+   kind_batch[kind][kind_count[kind]++] = new_ent;
+
+   hold_tile(new_ent, true);
+
+   return new_ent;
+}
 
    /* Load the level, render it, add entities */
 int load_lvl(char* lvl_file, char* walltile_file, char* background_file)
 {
+   SDL_Surface *background;
    SDL_Surface *walltiles;
-   FILE *lvlptr;
+
+   lvl_file = (char *) data_path(lvl_file);
 
       /* load files */
-   if ((background = load_image( "assets/background.png")) == NULL){
+   if ((background = load_image( background_file )) == NULL){
       printf("\nbackground image not found\n");
       return 0;}
    if ((walltiles = load_image( (char *) walltile_file))==NULL){
       printf("\nwalltile image not found");
       return 0;}
+
+#if TILE_LAYOUT == TILE_CHUNKED
+      /* only the header is read here, chunks come in as entities get near them */
+   if (!open_chunked_level(lvl_file)){
+      printf("\nlvl file %s could not be loaded\n", lvl_file);
+      return 0;}
+#else
+   FILE *lvlptr;
+
+   if (is_chunked_level(lvl_file))
+      return open_chunked_level(lvl_file);   //says what build it needs
+
    if ((lvlptr = fopen(lvl_file, "r"))==NULL){
       printf("\nlvl file %s image not found", lvl_file);
       return 0;}
 
-      /* load entity sprites */
-   enemy_image = TTF_RenderText_Solid( font, "E", textColor );
-   player_image = TTF_RenderText_Solid( font, "P", textColor );
-   powered_player_image = TTF_RenderText_Solid( font, "P", poweredColor);
-   snitch_image = TTF_RenderText_Solid( font, "*", textColor );
-
       /* get dimension then get level layout */
 
    fscanf(lvlptr,"%dx%d\n",&width,&height);
@@ -215,10 +373,12 @@ int load_lvl(char* lvl_file, char* walltile_file, char* background_file)
    int x=0;
    int y=1;
    char ttype;
-   Tile *tileptr;
 
-   game_field = (Tile*) calloc(width*height, sizeof(Tile));
-   tileptr = game_field;
+   if (alloc_field(width, height)==NULL){
+      printf("\nNo memory for a %dx%d level\n",width,height);
+      return 0;
+   }
+   reset_pellets(width, height);
 
    while ((ttype=fgetc(lvlptr))!=EOF)
    {
@@ -231,8 +391,10 @@ int load_lvl(char* lvl_file, char* walltile_file, char* background_file)
          y++;
       }
       else{
-         tileptr->type=ttype;
-         tileptr++;
+         if (x>=width || y>height){
+            printf("\nBad level layout, tile %d,%d is out of bounds\n",x,y-1);
+            return 0;}
+         tile_at(x,y-1).type=ttype;
          x++;
       }
    }
@@ -241,71 +403,34 @@ int load_lvl(char* lvl_file, char* walltile_file, char* background_file)
       printf("\ny dimension does not match, y is %d\n",y);
       return 0;}
 
-   /* render the game board and init entities */
-
-   SDL_Rect clip;
-   clip.w=16;
-   clip.h=16;
+   /* init entities, walls are baked by the viewport as they come on screen */
 
    for (y=0;y<height;y++)
    {
       for (x=0;x<width;x++)
       {
 
-         if (game_field[ y*width + x ].type == '#')
-         {
-            int frame =
-               (y-1>=0 && game_field[ (y-1)*width + x ].type == '#')
-               +2*(x-1>=0 && game_field[ y*width + x-1 ].type == '#' )
-               +4*(x+1<width && game_field[ y*width + x+1 ].type == '#')
-               +8*(y+1<height && game_field[ (y+1)*width + x ].type == '#');
-
-            clip.x = 16*(frame%4);
-            clip.y = 16*(frame/4);
-
-            apply_surface(x*16, y*16, walltiles, background, &clip);
-         }
-
-         else if (game_field[ y*width + x ].type == 'E') //if the current tile is an enemy
+         if (tile_at(x,y).type == 'E' || tile_at(x,y).type == '*') //an enemy or a snitch
          {
-            game_field[ y*width + x ].type = 'o';
-            packets++;
-
-            entity *new_ent = new_entity();
-
-            new_ent->type = 'E';
-            new_ent->x = new_ent->origx = x*16;
-            new_ent->y = new_ent->origy = y*16;
-            new_ent->image = enemy_image;
-         }
-         else if (game_field[ y*width + x ].type == 'P') //if the current tile is a player
-         {
-            entity *new_ent = new_entity();
-
-            new_ent->type = 'P';
-            new_ent->x = new_ent->origx = x*16;
-            new_ent->y = new_ent->origy = y*16;
-            new_ent->image = player_image;
-         }
-         else if (game_field[ y*width + x ].type == '*' )   //a snitch
-         {
-            game_field[ y*width + x ].type = 'o';
-            packets++;
-
-            entity *new_ent = new_entity();
-
-            new_ent->type = '*';
-            new_ent->x = new_ent->origx = x*16;
-            new_ent->y = new_ent->origy = y*16;
-            new_ent->image = snitch_image;
+            spawn_entity(tile_at(x,y).type, x, y);
+            tile_at(x,y).type = 'o';
+            pellet_set(x, y);
          }
-         else if (game_field[ y*width + x ].type == 'o') //a packet
-            packets++;
+         else if (tile_at(x,y).type == 'P') //if the current tile is a player
+            spawn_entity('P', x, y);
+         else if (tile_at(x,y).type == 'o') //a packet
+            pellet_set(x, y);
       }
    }
 
-   SDL_FreeSurface(walltiles);
    fclose(lvlptr);
+#endif
+
+   reset_view(background, walltiles);
+   reset_snapshots();
+   reset_input();
+   rewind_start();
+   died_at = 0;
 
    return 1;
 }
@@ -313,185 +438,240 @@ int load_lvl(char* lvl_file, char* walltile_file, char* background_file)
    /* get rid of the old level stuff */
 int cleanuplvl()
 {
-   free(game_field);
-   while (entity_list!=NULL){
-      entity *temp = entity_list;
-      entity_list = entity_list->next;
-      free(temp);
+   free_field();
+   free_pellets();
+   free_search();
+   free_rewind();
+   free_view();
+
+   for (int kind=0; kind<KINDS; kind++){
+      kind_batch[kind] = NULL;
+      kind_count[kind] = kind_room[kind] = 0;
    }
-   SDL_FreeSurface(background);
+   sweep_points = NULL;
+   sweep_count = sweep_room = 0;
+   ai_queue = NULL;
+   ai_room = 0;
 
-   game_field = NULL;
    entity_list = NULL;
-   background = NULL;
+   last_entity = NULL;
+   player = NULL;
+
+      /* the field, entities and everything else of the level, in one go */
+   level_reset();
+
+   return 1;
+}
+
+void hold_tile(entity *ent, bool hold)
+{
+   int x, y;
+
+   held_tile(ent, &x, &y);
+   if (x<0 || x>=width || y<0 || y>=height)
+      return;
+
+#if TILE_LAYOUT == TILE_CHUNKED
+      /* not worth loading a chunk for a sleeping entity, its count would go
+         with the chunk's next eviction anyway */
+   if (!entity_awake(ent) && chunk_table[(y>>CHUNK_SHIFT)*chunks_wide + (x>>CHUNK_SHIFT)]==NULL)
+      return;
+#endif
+
+   if (hold)
+      tile_at(x,y).occupied++;
+   else if (tile_at(x,y).occupied)
+      tile_at(x,y).occupied--;
 }
 
 /* when you die */
 void player_death()
 {
-      /* print death message */
+      /* print death message, the render thread puts up the banner */
    printf("You have just died. - You have died %d times so far.",losses);
-   char text[256];
-   snprintf(text,256,"You have just died.\nYou have died %d times so far.",losses);
-   SDL_Surface *banner = TTF_RenderText_Solid( font, text, textColor );
-   apply_surface((SCREEN_WIDTH-banner->w)/2, (SCREEN_HEIGHT-banner->h)/2,banner,screen);
-   snprintf(text,256,"Positions reset in 3 secs. You have %d lives left", deaths_to_lose-losses);
-   SDL_Surface *banner2 = TTF_RenderText_Solid( font, text, textColor );
-   apply_surface((SCREEN_WIDTH-banner->w)/2, (SCREEN_HEIGHT-banner->h)/2+20,banner2,screen);
-   SDL_Flip( screen );
-   SDL_FreeSurface(banner);
-   SDL_FreeSurface(banner2);
+   died_at = SDL_GetTicks();
+   next_turn = 0;
 
       /* reset player, enemy positions */
    entity **reset_ent = &entity_list;
    while (*reset_ent!=NULL){
+      hold_tile(*reset_ent, false);
       (*reset_ent)->x = (*reset_ent)->origx;
       (*reset_ent)->y = (*reset_ent)->origy;
+      (*reset_ent)->plan = 0;
+      hold_tile(*reset_ent, true);
       reset_ent = &((*reset_ent)->next);
    }
+}
 
-   SDL_Delay(3000);
+   /* the death banner, while the simulation sits out DEATH_PAUSE */
+void display_death(snapshot *snap)
+{
+   char text[256];
+   snprintf(text,256,"You have just died.\nYou have died %d times so far.",snap->losses);
+   SDL_Surface *banner = render_text( text, textColor );
+   apply_surface((SCREEN_WIDTH-banner->w)/2, (SCREEN_HEIGHT-banner->h)/2,banner,screen);
+   snprintf(text,256,"Positions reset in 3 secs. You have %d lives left", deaths_to_lose-snap->losses);
+   SDL_Surface *banner2 = render_text( text, textColor );
+   apply_surface((SCREEN_WIDTH-banner->w)/2, (SCREEN_HEIGHT-banner->h)/2+20,banner2,screen);
+   SDL_FreeSurface(banner);
+   SDL_FreeSurface(banner2);
 }
 
 
-/* display all non-static tiles, namely packets */
-int display_tiles()
+/* display all non-static tiles, namely packets. Only the set bits of the
+   snapshot's pellet blocks are looked at */
+int display_tiles(snapshot *snap)
 {
-   for (int x=0;x<width;x++)
+   int x0, y0, x1, y1;
+
+   visible_tiles(&x0, &y0, &x1, &y1);
+
+   int bx0 = std::max(x0>>PELLET_SHIFT, snap->bx0), bx1 = std::min(((x1-1)>>PELLET_SHIFT)+1, snap->bx1);
+   int by0 = std::max(y0>>PELLET_SHIFT, snap->by0), by1 = std::min(((y1-1)>>PELLET_SHIFT)+1, snap->by1);
+
+   for (int by=by0; by<by1; by++)
    {
-      for (int y=0; y<height;y++)
+      for (int bx=bx0; bx<bx1; bx++)
       {
-         if (game_field[y*width+x].type=='o')
-            apply_surface(x*16,y*16,packet,screen);
+         uint64_t block = snap->pellets[(by-snap->by0)*(snap->bx1-snap->bx0) + (bx-snap->bx0)];
+
+         while (block)
+         {
+            int b = __builtin_ctzll(block);
+            int x = bx*PELLET_BLOCK + (b&(PELLET_BLOCK-1));
+            int y = by*PELLET_BLOCK + (b>>PELLET_SHIFT);
+
+            block &= block-1;
+            if (x>=x0 && x<x1 && y>=y0 && y<y1)
+               blit_image(packet, x*16-camera_x, y*16-camera_y);
+         }
       }
    }
 
    return 1;
 }
 
-int display_entities()
+int display_entities(snapshot *snap)
 {
 
-   entity *ent_ptr = entity_list;
-
-   while (ent_ptr!=NULL)
+   for (int i=0; i<snap->count; i++)
    {
-      apply_surface(ent_ptr->x, ent_ptr->y, ent_ptr->image, screen);
-      ent_ptr = ent_ptr->next;
+      int x = snap->ents[i].draw_x - camera_x;
+      int y = snap->ents[i].draw_y - camera_y;
+
+      if (x>-16 && x<SCREEN_WIDTH && y>-16 && y<SCREEN_HEIGHT)
+         blit_image(snap->ents[i].image, x, y);
    }
 
    return 1;
 }
 
    /* display the ent_val of each tile, graphically */
-int display_tilevalues()
+int display_tilevalues(snapshot *snap)
 {
 
-   update_boardvalues();
-
    int alpha;
+   int x0, y0, x1, y1;
+
+   visible_tiles(&x0, &y0, &x1, &y1);
 
-   for (int x=0; x<width; x++)
+   for (int x=x0; x<x1; x++)
    {
-      for (int y=0; y<height; y++)
+      for (int y=y0; y<y1; y++)
       {
-         if (game_field[y*width+x].type=='#')
+         if (snapshot_type(snap,x,y)=='#')
             continue;
 
             /* to view pathes  */
-         alpha = SDL_ALPHA_TRANSPARENT + game_field[y*width+x].tvalue/20000 + 64;
+         alpha = SDL_ALPHA_TRANSPARENT + snap->tvalues[(y-snap->y0)*(snap->x1-snap->x0) + (x-snap->x0)]/20000 + 64;
 
          alpha = (alpha<SDL_ALPHA_OPAQUE) ? alpha : SDL_ALPHA_OPAQUE;
          alpha = (alpha>SDL_ALPHA_TRANSPARENT) ? alpha : SDL_ALPHA_TRANSPARENT;
 
          SDL_SetAlpha( redtile, SDL_SRCALPHA, alpha );
-         apply_surface( x*16, y*16, bluetile, screen );
-         apply_surface( x*16, y*16, redtile, screen );
+         apply_surface( x*16-camera_x, y*16-camera_y, bluetile, screen );
+         apply_surface( x*16-camera_x, y*16-camera_y, redtile, screen );
       }
    }
+
+   return 1;
 }
 
    /* the expense value of where to goto  */
 int follow_value(entity *ent_ptr, int distance)
 {
-   if (ent_ptr->type=='E')
-      return -6000000/(std::max(distance,1)*std::max(distance,1));
-   else if (ent_ptr->type=='*')
-      return 0;
-   return 15000000/std::max(distance,1);
+   static int (* const follow[KINDS])(int) = {
+      kind_traits<KIND_ENEMY>::follow,
+      kind_traits<KIND_SNITCH>::follow,
+      kind_traits<KIND_PLAYER>::follow };
+
+   return follow[ent_ptr->kind](distance);
 }
 
 /*
- *   resets the distance values for enemy pathfinding
+ *   resets the distance values for enemy pathfinding on screen
  *      only necessary when there's only one enemy
  */
-void reset_path()
+void reset_path(int x0, int y0, int x1, int y1)
 {
-   for (int x=0; x<width; x++)
+   for (int x=x0; x<x1; x++)
    {
-      for (int y=0; y<height; y++)
+      for (int y=y0; y<y1; y++)
       {
-         if (game_field[y*width+x].type=='#')
+         if (tile_at(x,y).type=='#')
             continue;
 
-         game_field[y*width+x].last = NULL;
-         game_field[y*width+x].tvalue = 0;
+         tile_at(x,y).last = NULL;
+         tile_at(x,y).tvalue = 0;
       }
    }
 
 }
 
-   /* update total values for tiles, basically only for viewing with display_tilevalues */
-int update_boardvalues()
+   /* update total values for tiles [x0,x1) x [y0,y1), basically only for viewing with display_tilevalues */
+int update_boardvalues(int x0, int y0, int x1, int y1)
 {
    entity *ent_ptr = entity_list;
 
-   reset_path(); //only necessary if there's only one enemy
+   reset_path(x0, y0, x1, y1); //only necessary if there's only one enemy
 
          /* set distance values on the board, then set follow values  */
    while (ent_ptr!=NULL)
    {
 
-      int ent_x = ent_ptr->x/16;
-      int ent_y = ent_ptr->y/16;
-
-      game_field[ent_y*width + ent_x].last = ent_ptr;
-      game_field[ent_y*width + ent_x].ent_val = 0;
+      flood_distances(ent_ptr);
 
-      set_value(ent_x,ent_y-1,ent_ptr,1,1);
-      set_value(ent_x-1,ent_y,ent_ptr,1,1);
-      set_value(ent_x+1,ent_y,ent_ptr,1,1);
-      set_value(ent_x,ent_y+1,ent_ptr,1,1);
-
-         /* update the tvalue for every tile*/
-      for (int x=0; x<width; x++)
+         /* update the tvalue for every tile on screen */
+      for (int x=x0; x<x1; x++)
       {
-         for (int y=0; y<height; y++)
+         for (int y=y0; y<y1; y++)
          {
-            if (game_field[y*width+x].type=='#')
+            if (tile_at(x,y).type=='#')
                continue;
    
-            entity *ent_ptr = game_field[y*width+x].last;
+            entity *ent_ptr = tile_at(x,y).last;
    
             if (ent_ptr==NULL)
                continue;
    
             if (ent_ptr==entity_list)
-               game_field[y*width+x].tvalue=0;
+               tile_at(x,y).tvalue=0;
    
-            game_field[y*width+x].tvalue += follow_value(ent_ptr, game_field[y*width+x].ent_val);
+            tile_at(x,y).tvalue += follow_value(ent_ptr, tile_at(x,y).ent_val);
          }
       }
 
       ent_ptr=ent_ptr->next;
    }
 
+   return 1;
 }
 
 /*
  *   If a valid tile, 
  *      and if tile has a smaller recorded distance to ent
- *         set distance to smaller, set_value to surronding
+ *         set distance to smaller, queue it to set_value its surroundings
  *   else do nothing
  *
  *      override is to override 
@@ -499,156 +679,321 @@ int update_boardvalues()
  */
 void set_value(int tilex, int tiley, entity *ent, int value, int override)
 {
-   // printf("{%d,%d,%d,%d}, ",tilex,tiley,value,game_field[tiley*width + tilex].ent_val);
-
-    // override=1;
+#ifdef FLOOD_HORIZON
+   if (value>FLOOD_HORIZON)
+      return;
+#endif
 
    if (tilex>=0 && tilex<width && tiley>=0 && tiley<height 
-      && game_field[tiley*width + tilex].type!='#' 
-      && (game_field[tiley*width + tilex].last!=ent 
-         || value<game_field[tiley*width + tilex].ent_val)
-      && (!game_field[tiley*width+tilex].occupied || value>2|| override))
+      && tile_at(tilex,tiley).type!='#' 
+      && (tile_at(tilex,tiley).flood!=flood_count 
+         || value<tile_at(tilex,tiley).ent_val)
+      && (!tile_at(tilex,tiley).occupied || value>2|| override))
    {
-      // printf(" tile was {%d,{%d,%d},%p},\n",game_field[tiley*width + tilex].ent_val,tilex,tiley,game_field[tiley*width + tilex].last);
+      tile_at(tilex,tiley).last = ent;
+      tile_at(tilex,tiley).ent_val = value;
+      tile_at(tilex,tiley).flood = flood_count;
 
-      game_field[tiley*width + tilex].last = ent;
-      game_field[tiley*width + tilex].ent_val = value;
+      flood_queue[flood_tail++] = tiley*width + tilex;
+   }
+}
 
-      // printf(" is now {%d,%p}\n",game_field[tiley*width + tilex].ent_val,game_field[tiley*width + tilex].last);
+/*
+ *   set the walking distance to ent on every tile it can reach.
+ *
+ *   Breadth first, so every tile is reached first with its smallest distance
+ *   and queued at most once. The old set_value recursed depth first, which
+ *   revisits tiles over and over on levels with loops and runs out of stack
+ *   on big ones. Its values only differed next to occupied tiles, where the
+ *   detour it happened to take first could win.
+ */
+int flood_distances(entity *ent)
+{
+   int ent_x = ent->x/16;
+   int ent_y = ent->y/16;
+   int head = 0;
+
+   flood_count++;
+
+   tile_at(ent_x,ent_y).last = ent;
+   tile_at(ent_x,ent_y).ent_val = 0;
+   tile_at(ent_x,ent_y).flood = flood_count;
+
+   flood_tail = 0;
+
+   set_value(ent_x,ent_y-1,ent,1,1);
+   set_value(ent_x-1,ent_y,ent,1,1);
+   set_value(ent_x+1,ent_y,ent,1,1);
+   set_value(ent_x,ent_y+1,ent,1,1);
 
-      set_value(tilex,tiley-1,ent,value+1,0);
-      set_value(tilex-1,tiley,ent,value+1,0);
-      set_value(tilex+1,tiley,ent,value+1,0);
-      set_value(tilex,tiley+1,ent,value+1,0);
+   while (head<flood_tail)
+   {
+      int x = flood_queue[head]%width;
+      int y = flood_queue[head]/width;
+      int value = tile_at(x,y).ent_val+1;
+
+      head++;
+
+      set_value(x,y-1,ent,value,0);
+      set_value(x-1,y,ent,value,0);
+      set_value(x+1,y,ent,value,0);
+      set_value(x,y+1,ent,value,0);
    }
+
+   return flood_tail;
 }
 
 
 
    
+   /* add what every entity of kind OTHER is worth to the four tiles around x,y */
+template<int OTHER>
+void add_follow(entity *ent, int x, int y, int v[4])
+{
+   if (kind_traits<OTHER>::reach==0)
+      return;
+
+   for (int i=0; i<kind_count[OTHER]; i++)
+   {
+      entity *ent_ptr = kind_batch[OTHER][i];
+
+      if (ent_ptr==ent)
+         continue;
+
+      if (kind_traits<OTHER>::reach>0
+         && abs(ent_ptr->x/16-x) + abs(ent_ptr->y/16-y) > kind_traits<OTHER>::reach)
+         continue;
+
+      flood_distances(ent_ptr);
+
+      if (tile_at(x,y-1).type!='#' && FLOOD_REACHED(tile_at(x,y-1),ent_ptr)){
+         v[0] += kind_traits<OTHER>::follow(tile_at(x,y-1).ent_val);
+      }
+      if (tile_at(x-1,y).type!='#' && FLOOD_REACHED(tile_at(x-1,y),ent_ptr)){
+         v[1] += kind_traits<OTHER>::follow(tile_at(x-1,y).ent_val);
+      }
+      if (tile_at(x+1,y).type!='#' && FLOOD_REACHED(tile_at(x+1,y),ent_ptr)){
+         v[2] += kind_traits<OTHER>::follow(tile_at(x+1,y).ent_val);
+      }
+      if (tile_at(x,y+1).type!='#' && FLOOD_REACHED(tile_at(x,y+1),ent_ptr)){
+         v[3] += kind_traits<OTHER>::follow(tile_at(x,y+1).ent_val);
+      }
+   }
+}
+
+   /* the way ent was going if it is open, else the first open way that does not turn back */
+static void keep_going(entity *ent, int x, int y)
+{
+   bool open[5] = { false,
+      tile_at(x,y-1).type!='#', tile_at(x-1,y).type!='#',
+      tile_at(x+1,y).type!='#', tile_at(x,y+1).type!='#' };
+
+   if (ent->direction!=0 && open[(int)ent->direction])
+      return;
+
+   for (int dir=1; dir<=4; dir++){
+      if (open[dir] && dir!=5-ent->direction){
+         ent->direction = dir;
+         return;
+      }
+   }
+
+      /* dead end */
+   ent->direction = open[5-ent->direction] ? 5-ent->direction : 0;
+}
+
+template<int K>
+int decide(entity *ent, int x, int y);
+
 /* For enemies. Calculate best path to take.
  *
- * if there are only two ways to go [forward & backward], continue along path
- *
- *   cycle through all other active entities:
- *      for every entity, go through tiles and calculate min distance to it for each path
+ * if there are only two ways to go [forward & backward], continue along path.
+ * Otherwise a way decided on the way here, or decide() if it is its turn to think
  */
+template<int K>
 int calc_path(entity *ent)
 {
    int x=ent->x/16;
    int y=ent->y/16;
+   int plan=ent->plan;
+
+   ent->plan = 0;
 
       /* continue along path */
-   if (((game_field[(y-1)*width+x].type!='#')
-      +(game_field[y*width+x-1].type!='#')
-      +(game_field[y*width+x+1].type!='#')
-      +(game_field[(y+1)*width+x].type!='#'))==2)
+   if (((tile_at(x,y-1).type!='#')
+      +(tile_at(x-1,y).type!='#')
+      +(tile_at(x+1,y).type!='#')
+      +(tile_at(x,y+1).type!='#'))==2)
    {
-      if (ent->direction!=4 && (game_field[(y-1)*width+x].type!='#')){
+      if (ent->direction!=4 && (tile_at(x,y-1).type!='#')){
          ent->direction=1;}
-      else if (ent->direction!=3 && (game_field[y*width+x-1].type!='#')){
+      else if (ent->direction!=3 && (tile_at(x-1,y).type!='#')){
          ent->direction=2;}
-      else if (ent->direction!=2 && (game_field[y*width+x+1].type!='#')){
+      else if (ent->direction!=2 && (tile_at(x+1,y).type!='#')){
          ent->direction=3;}
-      else if (ent->direction!=1 && game_field[(y+1)*width+x].type!='#'){
+      else if (ent->direction!=1 && tile_at(x,y+1).type!='#'){
          ent->direction=4;}
 
       return 1;
    }
 
-      /* for every entity, calculate distance. Then add it's inverse distance to
-         total move value */
+      /* the lookahead has a way out ready */
+   if (search_budget){
+      int dir = search_choice(ent, x, y);
 
-   entity *ent_ptr = entity_list;
+      if (dir){
+         ent->direction = dir;
+         return 1;
+      }
+   }
 
-         //the total move value for tiles in pos 1,2,3,4. 
-   int v0=0,v1=0,v2=0,v3=0;
+      /* decided on the way here */
+   if (plan){
+      ent->direction = plan;
+      return 1;
+   }
 
-   // reset_path(); //only necessary if there's only one enemy
+      /* not its turn to think, keep going the way it was */
+   if (!ent->think){
+      ai_reused++;
+      keep_going(ent, x, y);
+      return 1;
+   }
+   ai_decisions++;
 
-   while (ent_ptr!=NULL)
-   {
+   ent->direction = decide<K>(ent, x, y);
 
+   return 1;
+}
 
-      if (ent_ptr==ent){
-         ent_ptr=ent_ptr->next;
-         continue;
-      }
+/*
+ *   The way for ent to go from junction x,y, ent->direction if none is better.
+ *
+ *   cycle through all other active entities:
+ *      for every entity, go through tiles and calculate min distance to it for each path
+ *
+ *   chasing kinds take the best value, fleeing kinds the worst
+ */
+template<int K>
+int decide(entity *ent, int x, int y)
+{
+   int dir = ent->direction;
 
-      int ent_x = ent_ptr->x/16;
-      int ent_y = ent_ptr->y/16;
+      /* for every entity, calculate distance. Then add it's inverse distance to
+         total move value */
 
-      game_field[ent_y*width + ent_x].last = ent_ptr;
-      game_field[ent_y*width + ent_x].ent_val = 0;
+         //the total move value for tiles in pos 1,2,3,4. 
+   int v[4]={0,0,0,0};
 
-      set_value(ent_x,ent_y-1,ent_ptr,1,1);
-      set_value(ent_x-1,ent_y,ent_ptr,1,1);
-      set_value(ent_x+1,ent_y,ent_ptr,1,1);
-      set_value(ent_x,ent_y+1,ent_ptr,1,1);
+   // reset_path(); //only necessary if there's only one enemy
 
-      if (game_field[(y-1)*width+x].type!='#'){
-         v0 += follow_value(ent_ptr, game_field[(y-1)*width+x].ent_val);
-      }
-      if (game_field[y*width+x-1].type!='#'){
-         v1 += follow_value(ent_ptr, game_field[y*width+x-1].ent_val);
-      }
-      if (game_field[y*width+x+1].type!='#'){
-         v2 += follow_value(ent_ptr, game_field[y*width+x+1].ent_val);
-      }
-      if (game_field[(y+1)*width+x].type!='#'){
-         v3 += follow_value(ent_ptr, game_field[(y+1)*width+x].ent_val);
-      }
+   add_follow<KIND_ENEMY>(ent, x, y, v);
+   add_follow<KIND_SNITCH>(ent, x, y, v);
+   add_follow<KIND_PLAYER>(ent, x, y, v);
 
-      ent_ptr=ent_ptr->next;
-   }
-   if (game_field[(y-1)*width+x].type=='#')
+   int v0=v[0], v1=v[1], v2=v[2], v3=v[3];
+
+   if (tile_at(x,y-1).type=='#')
       v0 = -INT_MAX;
-   if (game_field[y*width+x-1].type=='#')
+   if (tile_at(x-1,y).type=='#')
       v1 = -INT_MAX;
-   if (game_field[y*width+x+1].type=='#')
+   if (tile_at(x+1,y).type=='#')
       v2 = -INT_MAX;
-   if (game_field[(y+1)*width+x].type=='#')
+   if (tile_at(x,y+1).type=='#')
       v3 = -INT_MAX;
 
    // printf("{%d,%d,%d,%d}:",v0,v1,v2,v3);
 
-   if (ent->type=='E'){
+   if (kind_traits<K>::steering==STEER_CHASE){
       if (v0>=v1 && v0>=v2 && v0>=v3)
-         ent->direction=1;
+         dir=1;
       else if (v1>=v0 && v1>=v2 && v1>=v3)
-         ent->direction=2;
+         dir=2;
       else if (v2>=v0 && v2>=v1 && v2>=v3)
-         ent->direction=3;
+         dir=3;
       else if (v3>=v0 && v3>=v1 && v3>=v2)
-         ent->direction=4;
+         dir=4;
    }
-   if (ent->type=='*'){
+   else if (kind_traits<K>::steering==STEER_FLEE){
       v0 = (v0==-INT_MAX)? INT_MAX : v0;
       v1 = (v1==-INT_MAX)? INT_MAX : v1;
       v2 = (v2==-INT_MAX)? INT_MAX : v2;
       v3 = (v3==-INT_MAX)? INT_MAX : v3;
-      // printf("choosing dir for snitch");
       if (v0<=v1 && v0<=v2 && v0<=v3)
-         ent->direction=1;
+         dir=1;
       else if (v0!=-INT_MAX && v1<=v0 && v1<=v2 && v1<=v3)
-         ent->direction=2;
+         dir=2;
       else if (v0!=-INT_MAX && v2<=v0 && v2<=v1 && v2<=v3)
-         ent->direction=3;
+         dir=3;
       else if (v0!=-INT_MAX && v3<=v0 && v3<=v1 && v3<=v2)
-         ent->direction=4;
+         dir=4;
    }
 
-   // printf("%d\n",ent->direction);
+   // printf("%d\n",dir);
+
+   return dir;
 }
 
 
 
+   /* pixel step for each direction */
+static const int dir_dx[5] = { 0, 0, -1, 1, 0 };
+static const int dir_dy[5] = { 0, -1, 0, 0, 1 };
+
 /*    For entity direction, values are as below
  *         1
  *       2 P 3
  *         4
  *               where 0 is not moving at all
  */
+   /* the player on arrow keys, at tile x,y */
+static int steer_keys(entity *ent_ptr, int x, int y)
+{
+   int old_dir = ent_ptr->direction;
+   int dir;
+
+      /* a buffered turn first, however briefly its key was down */
+   if (next_turn && tile_at(x+dir_dx[next_turn],y+dir_dy[next_turn]).type!='#')
+      dir = next_turn;
+
+        /*if 2 keys down*/
+   else if (previous_dir && (input_held[1]+input_held[2]+input_held[3]+input_held[4]>1))
+   {
+      if (input_held[1] && previous_dir!=1 && tile_at(x,y-1).type!='#')
+         dir = 1;
+      else if (input_held[2] && previous_dir!=2 && tile_at(x-1,y).type!='#')
+         dir = 2;
+      else if (input_held[3] && previous_dir!=3 && tile_at(x+1,y).type!='#')
+         dir = 3;
+      else if (input_held[4] && previous_dir!=4 && tile_at(x,y+1).type!='#')
+         dir = 4;
+      else
+         dir = 0;
+
+   }
+   else
+   {
+      if (input_held[1] && tile_at(x,y-1).type!='#')
+         dir = 1;
+      else if (input_held[2] && tile_at(x-1,y).type!='#')
+         dir = 2;
+      else if (input_held[3] && tile_at(x+1,y).type!='#')
+         dir = 3;
+      else if (input_held[4] && tile_at(x,y+1).type!='#')
+         dir = 4;
+      else
+         dir = 0;
+   }
+
+   if (dir && (dir!=old_dir || dir==next_turn))
+      turn_taken(dir);
+
+   return dir;
+}
+
+const controller key_controller = { "keys", steer_keys };
+
+template<int K>
 int choosedir(entity *ent_ptr)
 {
 
@@ -661,267 +1006,606 @@ int choosedir(entity *ent_ptr)
    int x = ent_ptr->x/16;
    int y = ent_ptr->y/16;
 
-   if (ent_ptr->type=='P')   //TODO: replace previous_dir with plain old ->direction
+   if (kind_traits<K>::steering==STEER_KEYS)   //TODO: replace previous_dir with plain old ->direction
    {
-
-        Uint8 *keystates = SDL_GetKeyState( NULL );
-
-           /*if 2 keys down*/
-      if (previous_dir && ((keystates[ SDLK_UP ])+(keystates[ SDLK_LEFT ])+(keystates[ SDLK_RIGHT ])
-         +(keystates[ SDLK_DOWN ])>1))
-      {
-         if (keystates[ SDLK_UP ] && previous_dir!=1 && game_field[(y-1)*width+x].type!='#')
-            ent_ptr->direction = 1;
-         else if (keystates[ SDLK_LEFT ] && previous_dir!=2 && game_field[y*width+x-1].type!='#')
-            ent_ptr->direction = 2;
-         else if (keystates[ SDLK_RIGHT ] && previous_dir!=3 && game_field[y*width+x+1].type!='#')
-            ent_ptr->direction = 3;
-         else if (keystates[ SDLK_DOWN ] && previous_dir!=4 && game_field[(y+1)*width+x].type!='#')
-            ent_ptr->direction = 4;
-         else
-            ent_ptr->direction = 0;
-
-      }
-      else
-      {
-         if (keystates[ SDLK_UP ] && game_field[(y-1)*width+x].type!='#')
-            ent_ptr->direction = 1;
-         else if (keystates[ SDLK_LEFT ] && game_field[y*width+x-1].type!='#')
-            ent_ptr->direction = 2;
-         else if (keystates[ SDLK_RIGHT ] && game_field[y*width+x+1].type!='#')
-            ent_ptr->direction = 3;
-         else if (keystates[ SDLK_DOWN ] && game_field[(y+1)*width+x].type!='#')
-            ent_ptr->direction = 4;
-         else
-            ent_ptr->direction = 0;
-      }
+      ent_ptr->direction = player_controller->steer(ent_ptr, x, y);
       previous_dir = ent_ptr->direction;
    }
    else
    {
-      calc_path(ent_ptr);
+      calc_path<K>(ent_ptr);
    }
 
    return 1;
 }
 
-int move_entity(unsigned int distance, entity *ent_ptr)
+/*
+ *   If an entity goes onto a tile, eat what is there and mark the tile taken.
+ *   Running into other entities is found by collide() once everyone has moved.
+ */
+template<int K>
+int interact(entity *ent)
 {
+   int x = ent->x/16;
+   int y = ent->y/16;
 
-   if (distance == 0)
-      return 1;
-
-      //tile location
-   int x = (ent_ptr->x)/16;
-   int y = (ent_ptr->y)/16;
-   int lowx = (ent_ptr->x-1)/16;
-   int lowy = (ent_ptr->y-1)/16;
-
-   if (x<0 || x>=width || y<0 || y>=height){
-      printf(".");
+   if (ent->x%16!=0 || ent->y%16!=0 || x<0 || x>=width || y<0 || y>=height){
+      printf("\nbad values to interact\n");
       return 0;
    }
 
-   if (ent_ptr->x%16==0 && ent_ptr->y%16==0)
-   {
-      choosedir(ent_ptr);
+   if (kind_traits<K>::eats_packets && pellet_clear(x,y)){
+      tile_at(x,y).type='_';
+      rewind_eaten(x,y);
    }
 
-      //move
-   if (ent_ptr->direction==1){
-      if ( lowy*16 >= ent_ptr->y - distance)
-      {
-         distance -= (ent_ptr->y - lowy*16);
-         ent_ptr->y = 16*lowy;
-         interact(ent_ptr);
-         game_field[(lowy+1)*width+x].occupied=0;
-         move_entity(distance, ent_ptr);
-      }
-      else
-         ent_ptr->y-=distance;
-   }
-   else if (ent_ptr->direction==2){\
-      if (  lowx*16 >= ent_ptr->x - distance )
-      {
-         distance -= (ent_ptr->x - lowx*16);
-         ent_ptr->x = 16*lowx;
-         interact(ent_ptr);
-         game_field[y*width+lowx+1].occupied=0;
-         move_entity(distance, ent_ptr);
-      }
-      else
-         ent_ptr->x-=distance;
-   }
-   else if (ent_ptr->direction==3){
-      if ( (x+1)*16 <= ent_ptr->x + distance)
-      {
-         distance -= ((x+1)*16 - ent_ptr->x);
-         ent_ptr->x = 16*(x+1);
-         interact(ent_ptr);
-         game_field[y*width+x].occupied=0;
-         move_entity(distance, ent_ptr);
-      }
-      else
-         ent_ptr->x+=distance;
-   }
-   else if (ent_ptr->direction==4){
-      if ( (y+1)*16 <= ent_ptr->y + distance)
-      {
-         distance -= ((y+1)*16 - ent_ptr->y);
-         ent_ptr->y = 16*(y+1);
-         interact(ent_ptr);
-         game_field[y*width+x].occupied=0;
-         move_entity(distance, ent_ptr);
-      }
-      else{
-         ent_ptr->y+=distance;
-      }
+   tile_at(x,y).occupied++;
+
+   return 1;
+}
+
+   /* note where ent is, t into the tick, as the next corner of its path */
+static void add_sweep(entity *ent, float t)
+{
+   if (sweep_count==sweep_room){
+      sweep_points = (sweep_point *) level_grow(sweep_points, sweep_room*sizeof(sweep_point),
+         (sweep_room ? sweep_room*2 : 256)*sizeof(sweep_point));
+      sweep_room = sweep_room ? sweep_room*2 : 256;
    }
+
+   sweep_points[sweep_count].x = ent->x;
+   sweep_points[sweep_count].y = ent->y;
+   sweep_points[sweep_count].t = t;
+   sweep_count++;
+   ent->sweep_len++;
 }
 
 /*
- * Move entities until they reach a tile, then move in new direction
+ *   Walk an entity distance pixels, one tile edge at a time. On every edge it
+ *   reaches it interacts and leaves the old tile; on every tile it stands on with
+ *   distance left it picks a new direction. Any distance is one pass of the loop
+ *   per tile crossed, however long the frame was.
  *
+ *   Every edge goes into the entity's sweep for collide(). It moves at an even
+ *   speed through the tick, and if it stops it waits at its last corner.
  */
-int move_entities(unsigned int dtime)
+template<int K>
+int move_entity(unsigned int distance, entity *ent_ptr)
 {
-   entity *ent_ptr = entity_list;
+   unsigned int total = distance;
 
-   while (ent_ptr!=NULL)
+   ent_ptr->sweep = sweep_count;
+   ent_ptr->sweep_len = 0;
+   add_sweep(ent_ptr, 0);
+
+   while (distance > 0)
    {
+         //tile location
+      int x = (ent_ptr->x)/16;
+      int y = (ent_ptr->y)/16;
 
-      if (ent_ptr->type=='P'){
-         move_entity(dtime*PLAYER_SPEED,ent_ptr);
+      if (x<0 || x>=width || y<0 || y>=height){
+         printf(".");
+         return 0;
       }
-      else if (ent_ptr->type=='E'){
-         move_entity(dtime*ENEMY_SPEED,ent_ptr);
+
+      if (ent_ptr->x%16==0 && ent_ptr->y%16==0)
+      {
+         choosedir<K>(ent_ptr);
       }
-      else if (ent_ptr->type=='*'){
-         move_entity(dtime*SNITCH_SPEED,ent_ptr);
+
+      int dir = ent_ptr->direction;
+
+      if (dir<1 || dir>4)
+         break;
+
+         /* pixels to the next tile edge */
+      int edge = (dir_dx[dir] ? ent_ptr->x : ent_ptr->y) % 16;
+
+      if (dir==1 || dir==2)
+         edge = edge ? edge : 16;
+      else
+         edge = 16 - edge;
+
+      if (distance < (unsigned int) edge){
+         ent_ptr->x += dir_dx[dir]*(int)distance;
+         ent_ptr->y += dir_dy[dir]*(int)distance;
+         add_sweep(ent_ptr, 1);
+         break;
       }
-      ent_ptr = ent_ptr->next;
+
+      distance -= edge;
+      ent_ptr->x += dir_dx[dir]*edge;
+      ent_ptr->y += dir_dy[dir]*edge;
+      add_sweep(ent_ptr, (float)(total-distance)/total);
+
+         /* the tile it just left */
+      int leftx = ent_ptr->x/16 - dir_dx[dir];
+      int lefty = ent_ptr->y/16 - dir_dy[dir];
+
+      interact<K>(ent_ptr);
+      if (tile_at(leftx,lefty).occupied)   //chunks paged back in have lost theirs
+         tile_at(leftx,lefty).occupied--;
    }
 
    return 1;
 }
 
+   /* move every entity of kind K. Asleep ones still get a sweep, standing still */
+template<int K>
+void move_batch(unsigned int dtime)
+{
+   for (int i=0; i<kind_count[K]; i++)
+      move_entity<K>(entity_awake(kind_batch[K][i]) ? dtime*kind_traits<K>::speed : 0, kind_batch[K][i]);
+}
+
+   /* where ent's sweep has it at time t, inside corner i */
+static void sweep_at(entity *ent, int i, float t, float *x, float *y)
+{
+   sweep_point *p = sweep_points + ent->sweep + i;
+
+   if (i+1>=ent->sweep_len){
+      *x = p->x;
+      *y = p->y;
+      return;
+   }
+
+   float f = (t - p[0].t)/(p[1].t - p[0].t);
+
+   *x = p[0].x + (p[1].x - p[0].x)*f;
+   *y = p[0].y + (p[1].y - p[0].y)*f;
+}
+
+   /* narrow lo..hi down to when r, going from r0 at t0 to r1 at t1, is inside +-CONTACT_RADIUS */
+static bool axis_overlap(float r0, float r1, float t0, float t1, float *lo, float *hi)
+{
+   if (r0==r1)
+      return r0>-CONTACT_RADIUS && r0<CONTACT_RADIUS;
+
+   float ta = t0 + (-CONTACT_RADIUS - r0)/(r1 - r0)*(t1 - t0);
+   float tb = t0 + (CONTACT_RADIUS - r0)/(r1 - r0)*(t1 - t0);
+
+   *lo = std::max(*lo, std::min(ta,tb));
+   *hi = std::min(*hi, std::max(ta,tb));
+
+   return *lo < *hi;
+}
+
 /*
- *   If an entity goes onto a tile and interacts with any entities on tht tile
+ *   first time in the tick a and b came within CONTACT_RADIUS of each other on
+ *   both axes, or -1 if they never did. Both paths are straight between corners,
+ *   so the check walks the corners of both in time order and solves each piece.
  */
-
-int interact(entity *ent)
+static float sweep_contact(entity *a, entity *b)
 {
+   sweep_point *pa = sweep_points + a->sweep;
+   sweep_point *pb = sweep_points + b->sweep;
+   int i = 0, j = 0;
+   float t0 = 0;
 
-   if (ent->type=='E')
+   while (t0 < 1)
    {
-      entity *ent_ptr = entity_list;
+      while (i+1<a->sweep_len && pa[i+1].t<=t0)
+         i++;
+      while (j+1<b->sweep_len && pb[j+1].t<=t0)
+         j++;
 
-      int x = ent->x/16;
-      int y = ent->y/16;
+      float t1 = 1;
 
-      if (game_field[y*width+x].occupied)
-      {
-         while (ent_ptr!=NULL)
-         {
-            if (ent_ptr->type=='P' 
-               && ent_ptr->x/16+(ent_ptr->direction==2 && ent_ptr->x%16!=0)==x 
-               && ent_ptr->y/16+(ent_ptr->direction==1 && ent_ptr->y%16!=0)==y){
-               losses+=1;
-               printf("YOU LOST %d times\n",losses);
-               player_death();
-            }
-   
-            ent_ptr = ent_ptr->next;
-         }
-      }
+      if (i+1<a->sweep_len)
+         t1 = std::min(t1, pa[i+1].t);
+      if (j+1<b->sweep_len)
+         t1 = std::min(t1, pb[j+1].t);
+
+      float ax0, ay0, ax1, ay1, bx0, by0, bx1, by1;
+
+      sweep_at(a, i, t0, &ax0, &ay0);
+      sweep_at(a, i, t1, &ax1, &ay1);
+      sweep_at(b, j, t0, &bx0, &by0);
+      sweep_at(b, j, t1, &bx1, &by1);
+
+      float lo = t0, hi = t1;
 
-      game_field[y*width+x].occupied = true;
+      if (axis_overlap(ax0-bx0, ax1-bx1, t0, t1, &lo, &hi)
+         && axis_overlap(ay0-by0, ay1-by1, t0, t1, &lo, &hi))
+         return lo;
+
+      t0 = t1;
    }
-   else if (ent->type=='P')
+
+   return -1;
+}
+
+   /* queue every entity of kind K that gets to a junction within AI_LEAD ticks and is due a turn */
+template<int K>
+int queue_thinkers(unsigned int dtime, int n)
+{
+   if (kind_traits<K>::steering==STEER_KEYS)
+      return n;
+
+   for (int i=0; i<kind_count[K]; i++)
    {
+      entity *ent = kind_batch[K][i];
+      int x, y;
 
-      int x = ent->x/16;
-      int y = ent->y/16;
+      ent->think = 0;
 
-      entity *ent_ptr = entity_list;
+      if (!entity_awake(ent) || ent->plan)
+         continue;
 
-      if (ent->x%16!=0 || ent->y%16!=0 || x<0 || x>=width || y<0 || y>=height){
-         printf("\nbad values to interact\n");
-         return 0;
-      }
-   
-      if (game_field[y*width + x].type=='o'){
-         packets--;
-         game_field[y*width + x].type='_';
+         /* one that gets there just as a tick ends decides in the next */
+      int ahead = tile_ahead(ent, &x, &y);
+      int step = dtime*kind_traits<K>::speed;
+      int due = step ? ahead/step : ahead;
+
+      if (due>AI_LEAD)
+         continue;
+
+         /* corridors are followed without thinking */
+      if (((tile_at(x,y-1).type!='#') + (tile_at(x-1,y).type!='#')
+         + (tile_at(x+1,y).type!='#') + (tile_at(x,y+1).type!='#'))==2)
+         continue;
+
+      int dist = player ? abs(x-player->x/16) + abs(y-player->y/16) : 0;
+
+         /* far ones only ask as they get there */
+      if (dist>AI_NEAR && (due>0 || (i+ai_tick)%AI_STAGGER!=0))
+         continue;
+
+      if (n==ai_room){
+         ai_queue = (ai_wait *) level_grow(ai_queue, ai_room*sizeof(ai_wait),
+            (ai_room ? ai_room*2 : 64)*sizeof(ai_wait));
+         ai_room = ai_room ? ai_room*2 : 64;
       }
+      ai_queue[n].dist = dist;
+      ai_queue[n].due = due;
+      ai_queue[n].x = x;
+      ai_queue[n].y = y;
+      ai_queue[n].ent = ent;
+      n++;
+   }
 
-      if (game_field[y*width+x].occupied)
-      {
-         while (ent_ptr!=NULL)
-         {
-            if (ent_ptr->type=='E'                
-               && ent_ptr->x/16+(ent_ptr->direction==2 && ent_ptr->x%16!=0)==x 
-               && ent_ptr->y/16+(ent_ptr->direction==1 && ent_ptr->y%16!=0)==y){
-               losses+=1;
-               printf("YOU LOST %d times\n",losses);
-               player_death();
-            }
-            else if (ent_ptr->type=='*'                
-               && ent_ptr->x/16+(ent_ptr->direction==2 && ent_ptr->x%16!=0)==x 
-               && ent_ptr->y/16+(ent_ptr->direction==1 && ent_ptr->y%16!=0)==y){
-               printf("P interacted with *\n");
-               has_won=1;
-            }
-   
-            ent_ptr = ent_ptr->next;
-         }
+   return n;
+}
+
+static bool closer(const ai_wait &a, const ai_wait &b)
+{
+   return a.dist < b.dist;
+}
+
+/*
+ *   Hand out this tick's calc_path turns. Entities that will stand on a
+ *   junction within AI_LEAD ticks want one. Nearest to the player first, each
+ *   gets the latest tick before it is there with room left in AI_BUDGET, so
+ *   while there is room everyone decides as they get there. When more get
+ *   there in one tick than fit, the nearest still do and the others decide in
+ *   a tick before, from the tile they are heading for. Only those that fit
+ *   nowhere keep going their old way. Far ones only ask every AI_STAGGER
+ *   ticks, spread out by batch position, and only as they get there.
+ *
+ *   Nothing is kept from tick to tick but the plans made: the ticks after
+ *   this one are only held for the nearer entities, they are asked again.
+ */
+void schedule_ai(unsigned int dtime)
+{
+   static int (* const plan_for[KINDS])(entity *, int, int) = {
+      decide<KIND_ENEMY>, decide<KIND_SNITCH>, decide<KIND_PLAYER> };
+   int room[AI_LEAD+1];
+   int n = 0;
+
+   n = queue_thinkers<KIND_ENEMY>(dtime, n);
+   n = queue_thinkers<KIND_SNITCH>(dtime, n);
+   n = queue_thinkers<KIND_PLAYER>(dtime, n);
+
+   std::sort(ai_queue, ai_queue+n, closer);
+
+   for (int t=0; t<=AI_LEAD; t++)
+      room[t] = AI_BUDGET;
+
+   for (int i=0; i<n; i++)
+   {
+      entity *ent = ai_queue[i].ent;
+      int t = ai_queue[i].due;
+
+      while (t>=0 && room[t]==0)
+         t--;
+
+      if (t<0){
+         if (ai_queue[i].due==0)
+            ai_missed++;
+         continue;
       }
 
-      game_field[y*width+x].occupied = true;
+      room[t]--;
+      if (t>0)
+         continue;
 
+      if (ai_queue[i].due==0)
+         ent->think = 1;
+      else{
+         ent->plan = plan_for[ent->kind](ent, ai_queue[i].x, ai_queue[i].y);
+         ai_decisions++;
+         ai_planned++;
+      }
    }
-   else if (ent->type=='*')
-   {
-      entity *ent_ptr = entity_list;
 
-      int x = ent->x/16;
-      int y = ent->y/16;
+   ai_tick++;
+}
+
+   /* the earliest contact found so far this tick */
+struct contact_hit
+{
+   float t;
+   int what;
+   entity *a;
+   entity *b;
+};
+
+   /* check every A against every B, each pair of kinds only once */
+template<int A, int B>
+void find_contacts(contact_hit *hit)
+{
+   if (A>=B || kind_contact[A][B]==CONTACT_NONE)
+      return;
 
-      if (game_field[y*width+x].occupied)
+   for (int i=0; i<kind_count[A]; i++)
+   {
+      for (int j=0; j<kind_count[B]; j++)
       {
-         while (ent_ptr!=NULL)
-         {
-            if (ent_ptr->type=='P' 
-               && ent_ptr->x/16+(ent_ptr->direction==2 && ent_ptr->x%16!=0)==x 
-               && ent_ptr->y/16+(ent_ptr->direction==1 && ent_ptr->y%16!=0)==y){
-               printf("* interacted with P\n");
-               has_won=1;
-            }
-   
-            ent_ptr = ent_ptr->next;
+         float t = sweep_contact(kind_batch[A][i], kind_batch[B][j]);
+
+         if (t>=0 && (hit->what==CONTACT_NONE || t<hit->t)){
+            hit->t = t;
+            hit->what = kind_contact[A][B];
+            hit->a = kind_batch[A][i];
+            hit->b = kind_batch[B][j];
          }
       }
+   }
+}
 
-      game_field[y*width+x].occupied = true;
+/*
+ *   After everyone has moved, find who ran into who anywhere along the way.
+ *   Only the first contact in the tick counts, a death resets everybody anyway.
+ */
+int collide()
+{
+   contact_hit hit = { 0, CONTACT_NONE, NULL, NULL };
+
+   find_contacts<KIND_ENEMY,KIND_SNITCH>(&hit);
+   find_contacts<KIND_ENEMY,KIND_PLAYER>(&hit);
+   find_contacts<KIND_SNITCH,KIND_PLAYER>(&hit);
+
+   if (hit.what==CONTACT_DEATH){
+      losses+=1;
+      printf("YOU LOST %d times\n",losses);
+      player_death();
+   }
+   else if (hit.what==CONTACT_WIN){
+      printf("%c interacted with %c\n", hit.a->type, hit.b->type);
+      has_won=1;
    }
 
+   return 1;
 }
 
+/*
+ * Move entities until they reach a tile, then move in new direction
+ *
+ */
+int move_entities(unsigned int dtime)
+{
+   sweep_count = 0;
 
-   /* render the game */
-int render()
+   schedule_ai(dtime);
+
+   move_batch<KIND_ENEMY>(dtime);
+   move_batch<KIND_SNITCH>(dtime);
+   move_batch<KIND_PLAYER>(dtime);
+
+   collide();
+
+   return 1;
+}
+
+   /* draw a snapshot of the game, without flipping */
+int draw_game(snapshot *snap)
 {
-   apply_surface( 0, 0, background, screen );
+   interpolate_snapshot(snap, usec_now());
+   update_camera(snap);
+   draw_background(screen);
 
    if (renderpaths)
-      display_tilevalues();
+      display_tilevalues(snap);
 
-   if (display_entities() ==0 || display_tiles() ==0)
+   if (display_entities(snap) ==0 || display_tiles(snap) ==0)
       printf("bad display");
 
+   blit_flush(screen);
+
+   return 1;
+}
+
+/* render the game */
+int render()
+{
+   snapshot *snap = latest_snapshot();
+
+   if (!snap->ready)
+      return 0;
+
+   draw_game(snap);
+
+   if (snap->died_at && SDL_GetTicks()-snap->died_at < DEATH_PAUSE)
+      display_death(snap);
+
          //Update the screen
    if( SDL_Flip( screen ) == -1 )
       return 1;
+
+   return 0;
+}
+
+   /* copy what the render thread needs into a snapshot and publish it. ticks
+      is how many were just simulated, the render thread draws entities moving
+      from prev_x,prev_y over that long; 0 to draw them standing */
+void snap_game(unsigned int ticks)
+{
+   int px = player ? player->x : 0;
+   int py = player ? player->y : 0;
+   int cx, cy, x0, y0, x1, y1;
+   int count = 0;
+
+   camera_for(px, py, &cx, &cy);
+   tiles_under(cx, cy, SNAP_MARGIN, &x0, &y0, &x1, &y1);
+
+   if (renderpaths)
+      update_boardvalues(x0, y0, x1, y1);
+
+   for (int kind=0; kind<KINDS; kind++)
+      count += kind_count[kind];
+
+   int bx0 = x0>>PELLET_SHIFT, bx1 = ((x1-1)>>PELLET_SHIFT)+1;
+   int by0 = y0>>PELLET_SHIFT, by1 = ((y1-1)>>PELLET_SHIFT)+1;
+
+   snapshot *snap = begin_snapshot(count, (x1-x0)*(y1-y0), (bx1-bx0)*(by1-by0));
+
+   snap->tick = sim_ticks;
+   snap->packets = packets;
+   snap->losses = losses;
+   snap->died_at = died_at;
+   snap->player_x = px;
+   snap->player_y = py;
+   snap->player_prev_x = player ? player->prev_x : 0;
+   snap->player_prev_y = player ? player->prev_y : 0;
+   snap->published_at = usec_now();
+   snap->span = ticks*TICK_USEC;
+
+      /* only what is near the screen */
+   snap->count = 0;
+   for (entity *ent_ptr=entity_list; ent_ptr!=NULL; ent_ptr=ent_ptr->next)
+   {
+      if (ent_ptr->x/16<x0-1 || ent_ptr->x/16>=x1 || ent_ptr->y/16<y0-1 || ent_ptr->y/16>=y1)
+         continue;
+
+      snap->ents[snap->count].x = ent_ptr->x;
+      snap->ents[snap->count].y = ent_ptr->y;
+      snap->ents[snap->count].prev_x = ent_ptr->prev_x;
+      snap->ents[snap->count].prev_y = ent_ptr->prev_y;
+      snap->ents[snap->count].image = ent_ptr->image;
+      snap->count++;
+   }
+
+   snap->x0 = x0;
+   snap->y0 = y0;
+   snap->x1 = x1;
+   snap->y1 = y1;
+
+   for (int y=y0, i=0; y<y1; y++)
+   {
+      for (int x=x0; x<x1; x++, i++)
+      {
+         snap->types[i] = tile_at(x,y).type;
+         if (renderpaths)
+            snap->tvalues[i] = tile_at(x,y).tvalue;
+      }
+   }
+
+   snap->bx0 = bx0;
+   snap->by0 = by0;
+   snap->bx1 = bx1;
+   snap->by1 = by1;
+
+   for (int by=by0, i=0; by<by1; by++)
+      for (int bx=bx0; bx<bx1; bx++, i++)
+         snap->pellets[i] = pellet_blocks[by*pellet_blocks_wide + bx];
+
+   publish_snapshot();
+   heat_capture(sim_ticks, x0, y0, x1, y1);
+}
+
+/*
+ *   The simulation thread. Ticks the level every 20ms and publishes a
+ *   snapshot after each tick, until the level is won or lost or stop_sim()
+ *   asks it to quit. After a death it sits out DEATH_PAUSE.
+ */
+int simulate(void *unused)
+{
+   unsigned int last_frame = SDL_GetTicks()/20;
+   unsigned int ticks;
+   Uint32 seen_death = died_at;
+
+   snap_game(0);
+
+   while (!__atomic_load_n(&sim_stop, __ATOMIC_ACQUIRE))
+   {
+      int back = __atomic_exchange_n(&rewind_wanted, 0, __ATOMIC_ACQ_REL);
+
+      if (back==REWIND_ALL)
+         rewind_restart();
+      else if (back)
+         rewind_back(back);
+      if (back)
+         snap_game(0);
+
+         /* sleep to the next tick */
+      ticks = SDL_GetTicks()/20-last_frame;
+      if (ticks==0){
+         SDL_Delay(20 - SDL_GetTicks()%20);
+         continue;
+      }
+
+         /* after a stall only catch up MAX_CATCHUP ticks, the rest is dropped */
+      last_frame += ticks;
+
+      drain_input();
+      stream_chunks();
+      search_think(search_budget);
+      ticks = std::min(ticks, (unsigned int)MAX_CATCHUP);
+
+      for (entity *ent_ptr=entity_list; ent_ptr!=NULL; ent_ptr=ent_ptr->next){
+         ent_ptr->prev_x = ent_ptr->x;
+         ent_ptr->prev_y = ent_ptr->y;
+      }
+
+      move_entities(ticks);
+      rewind_record();
+      sim_ticks += ticks;
+
+      snap_game(ticks);
+
+      if (died_at!=seen_death){
+         seen_death = died_at;
+         while (SDL_GetTicks()-died_at < DEATH_PAUSE && !__atomic_load_n(&sim_stop, __ATOMIC_ACQUIRE))
+            SDL_Delay(10);
+         last_frame = SDL_GetTicks()/20;
+      }
+
+      if (packets<=0 || has_won || losses>=deaths_to_lose)
+         break;
+   }
+
+   __atomic_store_n(&sim_done, 1, __ATOMIC_RELEASE);
+   return 0;
+}
+
+void start_sim()
+{
+   sim_stop = 0;
+   sim_done = 0;
+   sim_ticks = 0;
+   sim_thread = SDL_CreateThread(simulate, NULL);
+}
+
+   /* stop the simulation thread and wait for it, the level is all ours after */
+void stop_sim()
+{
+   if (sim_thread==NULL)
+      return;
+
+   __atomic_store_n(&sim_stop, 1, __ATOMIC_RELEASE);
+   SDL_WaitThread(sim_thread, NULL);
+   sim_thread = NULL;
 }
 
 /* When you win a level */
@@ -932,10 +1616,10 @@ int winlvl(void)
 
    snprintf(text,256,"You've won level %d! You've died %d times so far",level,losses);
 
-   banner = TTF_RenderText_Solid( font, text, textColor );
+   banner = render_text( text, textColor );
 
-   if (display_entities() ==0 || display_tiles() ==0)
-      printf("bad display");
+   if (latest_snapshot()->ready)
+      draw_game(latest_snapshot());
 
    apply_surface( (
       SCREEN_WIDTH-
@@ -959,7 +1643,7 @@ int winlvl(void)
    //    printf("Congratulations you've won, and with %d lives to go!", deaths_to_lose-losses);
    //    char text[256];
    //    snprintf(text,256,"Congratulations you've won, and with %d lives to go!", deaths_to_lose-losses);
-   //    SDL_Surface *banner = TTF_RenderText_Solid( font, text, textColor );
+   //    SDL_Surface *banner = render_text( text, textColor );
    //    apply_surface((SCREEN_WIDTH-banner->w)/2, (SCREEN_HEIGHT-banner->h)/2-64,banner,screen);
    //    SDL_Flip( screen );
    //    SDL_FreeSurface(banner);
@@ -977,11 +1661,99 @@ int winlvl(void)
 int main( int argc, char* args[] )
 {
    renderpaths = false;
-   if (argc>=2){
-      if (args[1][0] == 'v')
+   bool benchmark = false;
+   char *trace_file = NULL;
+   bool trace_record = false;
+   bool trace_rewind = false;
+   char *first_level = (char *)"levels/level0";
+   char *heat_file = NULL;
+   char *serve_at = NULL;
+   int serve_rate = 1000000/TICK_USEC;
+   int soak_seconds = -1;   /* -1 for no soak run */
+   bool show_startup = false;
+   Uint64 launched = usec_now();   /* until the first frame is on screen */
+
+   for (int i=1; i<argc; i++)
+   {
+      if (strcmp(args[i],"bench")==0){
+         benchmark = true;
+         setenv("SDL_VIDEODRIVER","dummy",1);   //no window needed
+      }
+      else if (strcmp(args[i],"trace")==0 && i+2<argc
+         && (strcmp(args[i+1],"record")==0 || strcmp(args[i+1],"check")==0)){
+         setenv("SDL_VIDEODRIVER","dummy",1);
+         trace_file = args[i+2];
+         trace_record = strcmp(args[i+1],"record")==0;
+         i += 2;
+      }
+      else if (strcmp(args[i],"trace")==0 && i+1<argc && strcmp(args[i+1],"rewind")==0){
+         setenv("SDL_VIDEODRIVER","dummy",1);
+         trace_rewind = true;
+         i++;
+      }
+      else if (strcmp(args[i],"serve")==0 && i+1<argc){
+         setenv("SDL_VIDEODRIVER","dummy",1);
+         serve_at = args[++i];
+         if (i+1<argc && isdigit(args[i+1][0]))
+            serve_rate = atoi(args[++i]);
+      }
+      else if (strcmp(args[i],"bot")==0)
+         player_controller = &bot_controller;
+      else if (strcmp(args[i],"soak")==0){
+         setenv("SDL_VIDEODRIVER","dummy",1);
+         player_controller = &bot_controller;
+         soak_seconds = i+1<argc && isdigit(args[i+1][0]) ? atoi(args[++i]) : 0;
+      }
+      else if (strcmp(args[i],"pack")==0 && i+2<argc)
+         return pack_level(args[i+1], args[i+2]) ? 0 : 1;
+      else if (strcmp(args[i],"maze")==0 && i+2<argc){
+         int w=0, h=0;
+         if (sscanf(args[i+1], "%dx%d", &w, &h)!=2 || !gen_maze_file(args[i+2], w, h, time(NULL), w*h/400+1)){
+            printf("Packman: could not make a %s maze\n", args[i+1]);
+            return 1;
+         }
+         return 0;
+      }
+      else if (strcmp(args[i],"assets")==0)
+         return pack_assets(i+1<argc ? args[i+1] : (char *)ASSET_PACK) ? 0 : 1;
+      else if (strcmp(args[i],"heat")==0 && i+1<argc)
+         return show_heat(args[i+1], i+2<argc ? atoi(args[i+2]) : -1) ? 0 : 1;
+      else if (strncmp(args[i],"heat=",5)==0)
+         heat_file = args[i]+5;
+      else if (strncmp(args[i],"level=",6)==0)
+         first_level = args[i]+6;
+      else if (strncmp(args[i],"mem=",4)==0)
+         chunk_budget = (size_t)atol(args[i]+4)<<20;
+      else if (strncmp(args[i],"search=",7)==0)
+         search_budget = atoi(args[i]+7);
+      else if (strncmp(args[i],"fps=",4)==0)
+         target_fps = atoi(args[i]+4);
+      else if (strcmp(args[i],"startup")==0)
+         show_startup = true;
+      else if (args[i][0] == 'v')
          renderpaths = true;
       else{
-         printf("Packman: unrecognized argument. Only argument is 'v', for 'visualizations'\n");
+         printf("Packman: unrecognized argument. Arguments are\n"
+            "  v                      visualizations\n"
+            "  level=<file>           start on this level\n"
+            "  mem=<MB>               memory for level chunks, TILE_CHUNKED builds\n"
+            "  search=<usec>          let enemies look ahead for this long every frame\n"
+            "  fps=<n>                frames a second to draw, 0 for unlimited (default 60)\n"
+            "  startup                print how long the first frame took to show\n"
+            "  heat=<file>            record the AI's path values and distances every tick\n"
+            "  heat <file> [frame]    print a heat recording, or one frame of it\n"
+            "  bot                    the player plays by itself\n"
+            "  soak [seconds]         no window, the bot plays every level as fast as it can,\n"
+            "                         reporting ticks a second and memory (until ctrl-c)\n"
+            "  bench                  run the benchmarks\n"
+            "  serve <socket> [rate]  no window, send the game to clients on a Unix socket or\n"
+            "                         127.0.0.1 port, rate ticks a second (50, 0 for unlimited)\n"
+            "  trace record <file>    play every level on scripted keys, writing every tick\n"
+            "  trace check <file>     play them again, reporting where it differs from file\n"
+            "  trace rewind           play them going back now and then, checking it plays the same again\n"
+            "  maze <W>x<H> <file>    write a random maze level\n"
+            "  pack <level> <file>    write a level as a chunked level file\n"
+            "  assets [file]          decode the images and font into a pack (" ASSET_PACK ")\n");
          return 0;
       }
    }
@@ -998,57 +1770,96 @@ int main( int argc, char* args[] )
       return 1;
    }
 
+   if (benchmark){
+      int result = run_benchmarks();
+      clean_up();
+      return result;
+   }
+
+   if (trace_file!=NULL || trace_rewind){
+      int result = trace_file!=NULL ? run_trace(trace_record, trace_file) : run_rewind_check();
+      clean_up();
+      return result;
+   }
+
    SDL_WM_SetCaption( "Packman, Saviour of the Universe", NULL );
 
-   if ( !(load_lvl((char *)"levels/level0",(char *)"assets/walls_small.png",(char *)"assets/background.png")) ){
+   if (heat_file!=NULL && !start_heat(heat_file)){
+      clean_up();
+      return 1;
+   }
+
+   if ( !(load_lvl(first_level,(char *)"assets/walls_small.png",(char *)"assets/background.png")) ){
       printf("\nbad level load, quitting\n");
       return 1;
    }
 
-      //make sure this has same factor as below it
-   unsigned int last_frame = SDL_GetTicks()/20;
 
-   while (quit==false)
-   {
-      //Wait .2 seconds
-      SDL_Delay( 10 );
-
-      move_entities(SDL_GetTicks()/20-last_frame);
-      last_frame = SDL_GetTicks()/20;
-
-      if (packets<=0 || has_won){
-         has_won=0;
-         packets=0;
-         if (winlvl()==0){
-            printf("\nbad level load, quitting\n");
-            break;
-         }
-         last_frame = SDL_GetTicks()/20;
-      }
-      else if (losses>=deaths_to_lose){
-        printf("You died %d times and lost.",losses);
-        char text[32];
-        snprintf(text,32,"You died %d times and lost.",losses);
-        SDL_Surface *banner = TTF_RenderText_Solid( font, text, textColor );
-        apply_surface((SCREEN_WIDTH-banner->w)/2, (SCREEN_HEIGHT-banner->h)/2-32,banner,screen);
-        SDL_Flip( screen );
-        SDL_FreeSurface(banner);
-        SDL_Delay(6000);
-        break;
-      }
+   if (soak_seconds>=0){
+      int result = run_soak(first_level, soak_seconds);
+      clean_up();
+      return result;
+   }
 
-      if( SDL_Flip( screen ) == -1 )
-         return 1;
+   if (serve_at!=NULL){
+      int result = run_server(serve_at, first_level, serve_rate);
+      clean_up();
+      return result;
+   }
 
+   start_sim();
+   start_frames();
+
+   while (quit==false)
+   {
       while (SDL_PollEvent( &event ))
       {
          if (event.type==SDL_QUIT)
             quit=true;
+         else if ((event.type==SDL_KEYDOWN || event.type==SDL_KEYUP) && key_dir(event.key.keysym.sym))
+            push_input(key_dir(event.key.keysym.sym), event.type==SDL_KEYDOWN);
+         else if (event.type==SDL_KEYDOWN && event.key.keysym.sym==SDLK_BACKSPACE)
+            __atomic_add_fetch(&rewind_wanted, REWIND_STEP, __ATOMIC_ACQ_REL);
+         else if (event.type==SDL_KEYDOWN && event.key.keysym.sym==SDLK_r)
+            __atomic_store_n(&rewind_wanted, REWIND_ALL, __ATOMIC_RELEASE);
+      }
+
+         /* the simulation stops itself when the level is won or lost */
+      if (__atomic_load_n(&sim_done, __ATOMIC_ACQUIRE)){
+         stop_sim();
+
+         if (packets<=0 || has_won){
+            has_won=0;
+            packets=0;
+            if (winlvl()==0){
+               printf("\nbad level load, quitting\n");
+               break;
+            }
+            start_sim();
+            start_frames();
+         }
+         else if (losses>=deaths_to_lose){
+           printf("You died %d times and lost.",losses);
+           char text[32];
+           snprintf(text,32,"You died %d times and lost.",losses);
+           SDL_Surface *banner = render_text( text, textColor );
+           apply_surface((SCREEN_WIDTH-banner->w)/2, (SCREEN_HEIGHT-banner->h)/2-32,banner,screen);
+           SDL_Flip( screen );
+           SDL_FreeSurface(banner);
+           SDL_Delay(6000);
+           break;
+         }
       }
 
       render();
+      if (show_startup && launched && latest_snapshot()->ready){
+         printf("first frame %.1f ms after starting\n", (usec_now()-launched)/1000.0);
+         launched = 0;
+      }
+      end_frame();
    }
 
+   stop_sim();
    clean_up();
 
 }
@@ -0,0 +1,240 @@
+#ifndef PACKMAN_H
+#define PACKMAN_H
+
+#include "boilerplate.h"
+
+/*
+ *  Tile storage layouts. game_field is only ever touched through tile_at(),
+ *  so the layout can be picked at compile time with -DTILE_LAYOUT=...
+ *
+ *    TILE_ROWMAJOR   plain y*width+x
+ *    TILE_BLOCKED    TILE_BLOCK x TILE_BLOCK blocks, row-major inside and between blocks
+ *    TILE_MORTON     Z-order over the whole field, padded to a power of 2 square
+ *    TILE_CHUNKED    CHUNK x CHUNK chunks streamed in and out of a memory mapped
+ *                    level file, see chunks.cpp. There is no game_field at all.
+ */
+#define TILE_ROWMAJOR 0
+#define TILE_BLOCKED 1
+#define TILE_MORTON 2
+#define TILE_CHUNKED 3
+
+#ifndef TILE_LAYOUT
+#define TILE_LAYOUT TILE_ROWMAJOR
+#endif
+
+#define TILE_BLOCK_SHIFT 3
+#define TILE_BLOCK (1<<TILE_BLOCK_SHIFT)
+
+#define CHUNK_SHIFT 5
+#define CHUNK (1<<CHUNK_SHIFT)
+   /* chunks kept in around every entity, in chunks */
+#define CHUNK_PIN_RADIUS 2
+   /* entities further than this from the player, in chunks, wait where they
+      are on chunked levels, so only chunks near the player are ever pinned */
+#define CHUNK_AWAKE_RADIUS 4
+
+#if TILE_LAYOUT == TILE_CHUNKED
+      /* floods stop here so they never leave the chunks pinned around their entity */
+#define FLOOD_HORIZON (CHUNK*CHUNK_PIN_RADIUS)
+      /* tiles past the horizon keep whatever an older flood left on them */
+#define FLOOD_REACHED(tile,ent) ((tile).flood==flood_count)
+#else
+#define FLOOD_REACHED(tile,ent) true
+#endif
+
+struct Tile
+{
+   char type;
+      /* entities holding the tile, see held_tile() */
+   unsigned char occupied;
+
+      /* for enemy AI */
+   int ent_val;
+      /* the last enemy that looked at the tile */
+   struct entity *last;
+      /* the total value for a square */
+   int tvalue;
+      /* the flood_distances run that set ent_val */
+   unsigned int flood;
+};
+
+
+   /* linked list of entities */
+struct entity
+{
+   char type;
+   unsigned char kind;   /* entity_kind, see kinds.h */
+
+   int x;
+   int y;
+
+   int origx;
+   int origy;
+
+      /* where it was before the last tick, for drawing in between */
+   int prev_x;
+   int prev_y;
+
+   char direction;
+
+      /* allowed a full calc_path this tick, see schedule_ai */
+   bool think;
+      /* direction already decided for the next tile it gets to, 0 for none */
+   char plan;
+      /* lookahead state, see search.cpp */
+   struct search_job *job;
+
+      /* this tick's path, sweep_len corners from sweep_points[sweep] */
+   int sweep;
+   int sweep_len;
+
+   SDL_Surface *image;
+
+   struct entity *next;
+};
+
+/* level stuff, defined in packman.cpp */
+extern int width;
+extern int height;
+extern int field_stride;   /* blocks per block-row, only used by TILE_BLOCKED */
+
+extern struct entity *entity_list;
+extern struct entity *player;   /* the 'P' in entity_list */
+extern Tile* game_field;
+extern int *flood_queue;   /* room for every tile a flood can reach */
+extern unsigned int flood_count;   /* the latest flood_distances run */
+
+/* chunked levels, defined in chunks.cpp */
+extern Tile **chunk_table;   /* resident chunks by chunk index, NULL if not loaded */
+extern int chunks_wide;
+extern size_t chunk_budget;   /* bytes of resident chunks to aim for */
+
+Tile *load_chunk(int cx, int cy);   /* bring in a chunk, evicting old unpinned ones */
+
+extern int packets;
+extern int losses;
+extern int has_won;
+extern int level;   /* number of the levels/level file being played */
+extern int deaths_to_lose;
+extern int previous_dir;   /* the player's direction on its last tile */
+extern Uint32 died_at;   /* SDL_GetTicks of the last death this level, 0 for none */
+extern unsigned int ai_tick;   /* schedule_ai runs, staggers far entities */
+extern SDL_Surface *screen;
+
+   /* spread the low 16 bits of v out to the even bits */
+static inline unsigned int morton_spread(unsigned int v)
+{
+   v &= 0xFFFF;
+   v = (v | (v << 8)) & 0x00FF00FF;
+   v = (v | (v << 4)) & 0x0F0F0F0F;
+   v = (v | (v << 2)) & 0x33333333;
+   v = (v | (v << 1)) & 0x55555555;
+   return v;
+}
+
+   /* index of tile x,y in game_field for the compiled layout */
+static inline int tile_index(int x, int y)
+{
+#if TILE_LAYOUT == TILE_BLOCKED
+   unsigned int ux = x, uy = y;
+   return ((((uy>>TILE_BLOCK_SHIFT)*field_stride + (ux>>TILE_BLOCK_SHIFT)) << (2*TILE_BLOCK_SHIFT))
+      | ((uy&(TILE_BLOCK-1)) << TILE_BLOCK_SHIFT) | (ux&(TILE_BLOCK-1)));
+#elif TILE_LAYOUT == TILE_MORTON
+   return morton_spread(x) | (morton_spread(y) << 1);
+#else
+   return y*width + x;
+#endif
+}
+
+   /* the one way to get at a tile */
+static inline Tile &tile_at(int x, int y)
+{
+#if TILE_LAYOUT == TILE_CHUNKED
+   Tile *chunk = chunk_table[(y>>CHUNK_SHIFT)*chunks_wide + (x>>CHUNK_SHIFT)];
+
+   if (chunk==NULL)
+      chunk = load_chunk(x>>CHUNK_SHIFT, y>>CHUNK_SHIFT);
+
+   return chunk[((y&(CHUNK-1))<<CHUNK_SHIFT) | (x&(CHUNK-1))];
+#else
+   return game_field[tile_index(x,y)];
+#endif
+}
+
+   /* pixels until ent reaches its next tile, and that tile */
+static inline int tile_ahead(entity *ent, int *x, int *y)
+{
+   *x = ent->x/16;
+   *y = ent->y/16;
+
+   if (ent->x%16==0 && ent->y%16==0)
+      return 0;
+
+   switch (ent->direction){
+      case 1: return ent->y%16;
+      case 2: return ent->x%16;
+      case 3: (*x)++; return 16-ent->x%16;
+      case 4: (*y)++; return 16-ent->y%16;
+   }
+   return 2147483647;
+}
+
+   /* the tile ent holds: the last one it got onto, which it only lets go of
+      on getting onto the next. Moving up or left that is the one below or
+      right of x/16,y/16 */
+static inline void held_tile(entity *ent, int *x, int *y)
+{
+   *x = ent->x/16 + (ent->x%16!=0 && ent->direction==2);
+   *y = ent->y/16 + (ent->y%16!=0 && ent->direction==1);
+}
+
+   /* ent moves and thinks this tick. Always on levels held in memory */
+static inline bool entity_awake(entity *ent)
+{
+#if TILE_LAYOUT == TILE_CHUNKED
+   return player==NULL
+      || (abs((ent->x>>4>>CHUNK_SHIFT) - (player->x>>4>>CHUNK_SHIFT)) <= CHUNK_AWAKE_RADIUS
+         && abs((ent->y>>4>>CHUNK_SHIFT) - (player->y>>4>>CHUNK_SHIFT)) <= CHUNK_AWAKE_RADIUS);
+#else
+   return true;
+#endif
+}
+
+const char *tile_layout_name();   /* name of the compiled layout, for benchmarks */
+Tile *alloc_field(int w, int h);   /* allocate a zeroed field for the compiled layout, sets width/height */
+void free_field();   /* forget game_field and the flood queue, before the level's arena is reset */
+
+int pack_level(const char *lvl_file, const char *out_file);   /* level file to chunked level file */
+int is_chunked_level(const char *lvl_file);
+int open_chunked_level(const char *lvl_file);   /* packs plain level files on the fly */
+void close_chunked_level();
+void print_chunk_stats();
+
+#if TILE_LAYOUT == TILE_CHUNKED
+void stream_chunks();   /* once a tick: pin chunks around entities, evict down to the budget */
+#else
+static inline void stream_chunks() {}
+#endif
+
+bool load_files();   /* fonts and shared images */
+struct entity* new_entity();   /* append a zeroed entity to entity_list */
+struct entity* spawn_entity(char type, int x, int y);
+void hold_tile(entity *ent, bool hold);   /* take or let go of ent's held_tile() */
+int load_lvl(char* lvl_file, char* walltile_file, char* background_file);
+int cleanuplvl();
+int update_boardvalues(int x0, int y0, int x1, int y1);   /* tvalue for tiles [x0,x1) x [y0,y1) */
+int flood_distances(entity *ent);   /* set ent_val/last to the walking distance from ent, returns tiles reached */
+void snap_game(unsigned int ticks);   /* simulation side: publish what is on and around the screen after ticks more ticks */
+int draw_game(struct snapshot *snap);   /* render side: draw a snapshot, without flipping */
+int move_entities(unsigned int dtime);   /* one tick: think, move every batch, collide */
+
+extern long ai_decisions;   /* calc_path runs that flooded */
+extern long ai_reused;   /* junctions passed on an old decision */
+extern long ai_planned;   /* decisions made before the entity got to its junction */
+extern long ai_missed;   /* junctions reached with no room left for a decision */
+
+int run_benchmarks();   /* bench.cpp */
+int run_trace(bool record, const char *path);   /* trace.cpp, returns 0 if nothing differed */
+int run_rewind_check();   /* trace.cpp, returns 0 if every tick played again came out the same */
+
+#endif
@@ -0,0 +1,327 @@
+/*
+ * The pellet bitmap, see pellets.h.
+ *
+ *   Every level of it is words of 8x8 cells: tiles at the bottom, blocks
+ *   one up, 8x8 blocks the one above that. A cell at level k is
+ *   1<<(3*k) tiles a side. A summary bit is set exactly when the word it
+ *   stands for is not zero, so setting a pellet only goes up while words
+ *   were empty and clearing one only while they become empty.
+ */
+
+#include <limits.h>
+#include <algorithm>
+
+#include "pellets.h"
+#include "arena.h"
+
+uint64_t *pellet_blocks = NULL;
+int pellet_blocks_wide = 0;
+unsigned int pellet_changes = 0;
+
+static uint64_t *words[PELLET_LEVELS];
+static int wide[PELLET_LEVELS];   /* words across at each level */
+static int high[PELLET_LEVELS];
+static int levels = 0;
+
+static inline uint64_t &word_of(int k, int cx, int cy)
+{
+   return words[k][(cy>>PELLET_SHIFT)*wide[k] + (cx>>PELLET_SHIFT)];
+}
+
+static inline uint64_t bit_of(int cx, int cy)
+{
+   return 1ull << (((cy&(PELLET_BLOCK-1))<<PELLET_SHIFT) | (cx&(PELLET_BLOCK-1)));
+}
+
+   /* words across and down at every level for a w x h level, returns how many levels */
+static int layout(int w, int h, int *across, int *down)
+{
+   int cells_wide = w, cells_high = h;
+   int k = 0;
+
+   do{
+      across[k] = (cells_wide+PELLET_BLOCK-1)>>PELLET_SHIFT;
+      down[k] = (cells_high+PELLET_BLOCK-1)>>PELLET_SHIFT;
+
+      cells_wide = across[k];
+      cells_high = down[k];
+      k++;
+   } while ((cells_wide>1 || cells_high>1) && k<PELLET_LEVELS);
+
+   return k;
+}
+
+size_t pellet_words(int w, int h)
+{
+   int across[PELLET_LEVELS], down[PELLET_LEVELS];
+   int n = layout(w, h, across, down);
+   size_t total = 0;
+
+   for (int k=0; k<n; k++)
+      total += (size_t)across[k]*down[k];
+
+   return total;
+}
+
+void sum_pellets(int w, int h, uint64_t *mem)
+{
+   int across[PELLET_LEVELS], down[PELLET_LEVELS];
+   int n = layout(w, h, across, down);
+
+   for (int k=0; k+1<n; k++)
+   {
+      uint64_t *above = mem + (size_t)across[k]*down[k];
+
+      for (int wy=0; wy<down[k]; wy++)
+         for (int wx=0; wx<across[k]; wx++)
+            if (mem[(size_t)wy*across[k] + wx])
+               above[(wy>>PELLET_SHIFT)*across[k+1] + (wx>>PELLET_SHIFT)] |= bit_of(wx, wy);
+
+      mem = above;
+   }
+}
+
+   /* point the levels one after another into mem */
+static void use_words(int w, int h, uint64_t *mem)
+{
+   levels = layout(w, h, wide, high);
+
+   for (int k=0; k<levels; k++){
+      words[k] = mem;
+      mem += (size_t)wide[k]*high[k];
+   }
+
+   pellet_blocks = words[0];
+   pellet_blocks_wide = wide[0];
+   pellet_changes++;
+}
+
+void reset_pellets(int w, int h)
+{
+   use_words(w, h, (uint64_t *) level_alloc(pellet_words(w, h)*sizeof(uint64_t)));
+   packets = 0;
+}
+
+void map_pellets(int w, int h, uint64_t *mem, int count)
+{
+   use_words(w, h, mem);
+   packets = count;
+}
+
+void free_pellets()
+{
+   for (int k=0; k<levels; k++)
+      words[k] = NULL;
+
+   levels = 0;
+   pellet_blocks = NULL;
+   pellet_blocks_wide = 0;
+}
+
+void pellet_set(int x, int y)
+{
+   if (x<0 || x>=width || y<0 || y>=height)
+      return;
+
+   pellet_changes++;
+
+   for (int k=0; k<levels; k++, x>>=PELLET_SHIFT, y>>=PELLET_SHIFT)
+   {
+      uint64_t &word = word_of(k, x, y);
+      uint64_t was = word;
+
+      if (was & bit_of(x,y))
+         return;
+
+      word |= bit_of(x,y);
+      if (k==0)
+         packets++;
+
+      if (was!=0)
+         return;
+   }
+}
+
+bool pellet_clear(int x, int y)
+{
+   if (x<0 || x>=width || y<0 || y>=height || !pellet_at(x,y))
+      return false;
+
+   packets--;
+   pellet_changes++;
+
+   for (int k=0; k<levels; k++, x>>=PELLET_SHIFT, y>>=PELLET_SHIFT)
+   {
+      uint64_t &word = word_of(k, x, y);
+
+      word &= ~bit_of(x,y);
+      if (word!=0)
+         break;
+   }
+
+   return true;
+}
+
+int count_pellets()
+{
+   int count = 0;
+
+   for (int i=0; i<wide[0]*high[0]; i++)
+      count += __builtin_popcountll(pellet_blocks[i]);
+
+   return count;
+}
+
+   /* cells [c0,c1] x [r0,r1] of a word, all inside 0..7 */
+static uint64_t cell_mask(int c0, int r0, int c1, int r1)
+{
+   uint64_t row = (0xFFull >> (7-(c1-c0))) << c0;
+   uint64_t rows = (~0ull >> (8*(7-(r1-r0)))) << (8*r0);
+
+   return (row*0x0101010101010101ull) & rows;
+}
+
+   /* the cells of word wx,wy at level k that have tiles in [x0,x1] x [y0,y1], inclusive */
+static uint64_t cells_in(int k, int wx, int wy, int x0, int y0, int x1, int y1)
+{
+   int shift = PELLET_SHIFT*k;
+   int c0 = std::max((x0>>shift) - (wx<<PELLET_SHIFT), 0);
+   int c1 = std::min((x1>>shift) - (wx<<PELLET_SHIFT), PELLET_BLOCK-1);
+   int r0 = std::max((y0>>shift) - (wy<<PELLET_SHIFT), 0);
+   int r1 = std::min((y1>>shift) - (wy<<PELLET_SHIFT), PELLET_BLOCK-1);
+
+   if (c0>c1 || r0>r1)
+      return 0;
+
+   return words[k][wy*wide[k] + wx] & cell_mask(c0, r0, c1, r1);
+}
+
+   /* every pellet under word wx,wy at level k, blocks popcounted whole */
+static int count_all(int k, int wx, int wy)
+{
+   uint64_t cells = words[k][wy*wide[k] + wx];
+   int count = 0;
+
+   if (k==0)
+      return __builtin_popcountll(cells);
+
+   while (cells)
+   {
+      int b = __builtin_ctzll(cells);
+
+      cells &= cells-1;
+      count += count_all(k-1, (wx<<PELLET_SHIFT) | (b&(PELLET_BLOCK-1)), (wy<<PELLET_SHIFT) | (b>>PELLET_SHIFT));
+   }
+
+   return count;
+}
+
+   /* pellets under word wx,wy at level k in [x0,x1] x [y0,y1], inclusive. Cells
+      the region covers whole are counted whole, only the ones its edge cuts
+      are gone down into with a mask */
+static int count_in(int k, int wx, int wy, int x0, int y0, int x1, int y1)
+{
+   uint64_t cells = cells_in(k, wx, wy, x0, y0, x1, y1);
+   int shift = PELLET_SHIFT*k;
+   int count = 0;
+
+   if (k==0)
+      return __builtin_popcountll(cells);
+
+   while (cells)
+   {
+      int b = __builtin_ctzll(cells);
+      int cell_x = (wx<<PELLET_SHIFT) | (b&(PELLET_BLOCK-1));
+      int cell_y = (wy<<PELLET_SHIFT) | (b>>PELLET_SHIFT);
+      int lo_x = cell_x<<shift, hi_x = lo_x + (1<<shift) - 1;
+      int lo_y = cell_y<<shift, hi_y = lo_y + (1<<shift) - 1;
+
+      cells &= cells-1;
+      if (lo_x>=x0 && hi_x<=x1 && lo_y>=y0 && hi_y<=y1)
+         count += count_all(k-1, cell_x, cell_y);
+      else
+         count += count_in(k-1, cell_x, cell_y, x0, y0, x1, y1);
+   }
+
+   return count;
+}
+
+int pellets_in(int x0, int y0, int x1, int y1)
+{
+   int count = 0;
+
+   x0 = std::max(x0, 0);
+   y0 = std::max(y0, 0);
+   x1 = std::min(x1, width);
+   y1 = std::min(y1, height);
+
+   if (levels==0 || x0>=x1 || y0>=y1)
+      return 0;
+
+   for (int wy=0; wy<high[levels-1]; wy++)
+      for (int wx=0; wx<wide[levels-1]; wx++)
+         count += count_in(levels-1, wx, wy, x0, y0, x1-1, y1-1);
+
+   return count;
+}
+
+   /* nearest pellet to x,y under word wx,wy at level k, if nearer than *best */
+static void search(int k, int wx, int wy, int x, int y, int *best, int *px, int *py)
+{
+   uint64_t cells = words[k][wy*wide[k] + wx];
+   int shift = PELLET_SHIFT*k;
+   int dist[64], cx[64], cy[64];
+   int n = 0;
+
+      /* every cell with pellets, nearest first */
+   while (cells)
+   {
+      int b = __builtin_ctzll(cells);
+      int cell_x = (wx<<PELLET_SHIFT) | (b&(PELLET_BLOCK-1));
+      int cell_y = (wy<<PELLET_SHIFT) | (b>>PELLET_SHIFT);
+      int lo_x = cell_x<<shift, hi_x = lo_x + (1<<shift) - 1;
+      int lo_y = cell_y<<shift, hi_y = lo_y + (1<<shift) - 1;
+      int d = (x<lo_x ? lo_x-x : x>hi_x ? x-hi_x : 0) + (y<lo_y ? lo_y-y : y>hi_y ? y-hi_y : 0);
+      int i;
+
+      cells &= cells-1;
+      if (d>=*best)
+         continue;
+
+      for (i=n; i>0 && dist[i-1]>d; i--){
+         dist[i] = dist[i-1];
+         cx[i] = cx[i-1];
+         cy[i] = cy[i-1];
+      }
+      dist[i] = d;
+      cx[i] = cell_x;
+      cy[i] = cell_y;
+      n++;
+   }
+
+   for (int i=0; i<n && dist[i]<*best; i++)
+   {
+      if (k==0){
+         *best = dist[i];
+         *px = cx[i];
+         *py = cy[i];
+         return;
+      }
+
+      search(k-1, cx[i], cy[i], x, y, best, px, py);
+   }
+}
+
+int nearest_pellet(int x, int y, int *px, int *py)
+{
+   int best = INT_MAX;
+
+   if (levels==0)
+      return -1;
+
+   for (int wy=0; wy<high[levels-1]; wy++)
+      for (int wx=0; wx<wide[levels-1]; wx++)
+         search(levels-1, wx, wy, x, y, &best, px, py);
+
+   return best==INT_MAX ? -1 : best;
+}
@@ -0,0 +1,71 @@
+#ifndef PELLETS_H
+#define PELLETS_H
+
+#include <stdint.h>
+
+#include "packman.h"
+
+/*
+ *  Where the pellets are, one bit a tile.
+ *
+ *  The level is cut into PELLET_BLOCK x PELLET_BLOCK tile blocks, a 64 bit
+ *  word each, bit (y%8)*8 + x%8 set for a pellet on x,y. Over the blocks is
+ *  a summary with a bit for every block with a pellet left, 8x8 blocks to a
+ *  word again, over that another for every 64x64 tiles, and so on until one
+ *  word covers the level. Counting the pellets in a region popcounts the
+ *  blocks under summary cells it covers whole and only masks its way down
+ *  through the cells its edge cuts, and finding the nearest pellet only goes
+ *  down into summary bits that are set, so empty parts of a huge level cost
+ *  nothing.
+ *
+ *  Tile::type still says 'o' or '_' for everything that reads tiles (and
+ *  chunked levels keep eaten pellets that way). pellet_set and pellet_clear
+ *  are the only way pellets come and go, and they keep packets, the pellets
+ *  left, in step, so the win check never counts. count_pellets is for
+ *  checking that.
+ *
+ *  Chunked level files carry every level of the bitmap, laid out as
+ *  pellet_words says, and map_pellets uses them straight from the mapping.
+ */
+
+#define PELLET_SHIFT 3
+#define PELLET_BLOCK (1<<PELLET_SHIFT)
+   /* summaries over the blocks at most, enough for 2^24 tiles a side */
+#define PELLET_LEVELS 8
+
+extern uint64_t *pellet_blocks;   /* the bottom level, row by row of blocks */
+extern int pellet_blocks_wide;
+extern unsigned int pellet_changes;   /* goes up with every pellet set or cleared and every reset */
+
+void reset_pellets(int w, int h);   /* no pellets on a w x h level, from the level's arena */
+size_t pellet_words(int w, int h);   /* words of every level of the bitmap for a w x h level, blocks first */
+void sum_pellets(int w, int h, uint64_t *mem);   /* fill in the summaries over blocks already set in mem */
+void map_pellets(int w, int h, uint64_t *mem, int count);   /* use the bitmap at mem, count pellets in it */
+void free_pellets();   /* before the level's arena is reset */
+
+void pellet_set(int x, int y);
+bool pellet_clear(int x, int y);   /* returns whether there was one */
+int count_pellets();   /* popcount of every block */
+int pellets_in(int x0, int y0, int x1, int y1);   /* pellets in [x0,x1) x [y0,y1) */
+   /* the pellet fewest tiles across and down from x,y, walls not minded.
+      Returns that many tiles, -1 if there are none left */
+int nearest_pellet(int x, int y, int *px, int *py);
+
+   /* the block x,y is in */
+static inline uint64_t pellet_block(int x, int y)
+{
+   return pellet_blocks[(y>>PELLET_SHIFT)*pellet_blocks_wide + (x>>PELLET_SHIFT)];
+}
+
+   /* x,y's bit in its block */
+static inline uint64_t pellet_bit(int x, int y)
+{
+   return 1ull << (((y&(PELLET_BLOCK-1))<<PELLET_SHIFT) | (x&(PELLET_BLOCK-1)));
+}
+
+static inline bool pellet_at(int x, int y)
+{
+   return (pellet_block(x,y) & pellet_bit(x,y)) != 0;
+}
+
+#endif
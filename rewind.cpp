@@ -0,0 +1,356 @@
+/*
+ * Rewind ring, see rewind.h.
+ *
+ *   Frames are kept in frames[] by a running tick number, their bytes in a
+ *   ring of their own. A full copy is 10 bytes an entity: x and y as 4 bytes
+ *   each, the direction and its plan. In between, an entity that moved less
+ *   than 8 pixels each way and kept its direction and plan is one byte,
+ *   (dx+8)<<4 | (dy+8); anything else is a 0 byte and a full copy of just
+ *   that entity. Dropping old ticks always drops up to the next full copy,
+ *   so the oldest tick kept is always one.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "rewind.h"
+#include "arena.h"
+#include "pellets.h"
+#include "input.h"
+
+struct ent_state
+{
+   int x;
+   int y;
+   char direction;
+   char plan;
+};
+
+struct rewind_frame
+{
+   unsigned long at;   /* first byte, in the running byte count */
+   bool key;   /* a full copy */
+
+   int losses;
+   int has_won;
+   int previous_dir;
+   int next_turn;
+   Uint32 died_at;
+   unsigned int ai_tick;
+   int eaten;   /* length of the eaten log */
+};
+
+   /* entity_list in order, as indexed in every frame */
+static entity **ents = NULL;
+static int ent_count = 0;
+
+static ent_state *start = NULL;   /* as the level started */
+static rewind_frame start_frame;
+static ent_state *last = NULL;   /* as of the newest frame */
+static ent_state *scratch = NULL;
+
+static rewind_frame frames[REWIND_FRAMES];   /* by tick number modulo REWIND_FRAMES */
+static unsigned long first_frame = 0;   /* oldest kept, always a full copy */
+static unsigned long next_frame = 0;
+static unsigned long last_key = 0;
+
+static unsigned char *bytes = NULL;
+static unsigned long byte_room = 0;
+static unsigned long byte_head = 0;   /* running count, oldest byte kept */
+static unsigned long byte_tail = 0;
+
+   /* tiles eaten this level, as y*width+x */
+static int *eaten = NULL;
+static int eaten_count = 0;
+static int eaten_room = 0;
+
+   /* for print_rewind_stats */
+static long frames_recorded = 0;
+static long bytes_recorded = 0;
+static long full_bytes = 0;   /* what it would have been as full copies */
+static long rewinds = 0;
+
+static void put_byte(unsigned char b)
+{
+   bytes[byte_tail++ % byte_room] = b;
+}
+
+static void put_int(int v)
+{
+   for (int i=0; i<4; i++)
+      put_byte((unsigned int)v >> (i*8));
+}
+
+static unsigned char get_byte(unsigned long *at)
+{
+   return bytes[(*at)++ % byte_room];
+}
+
+static int get_int(unsigned long *at)
+{
+   unsigned int v = 0;
+
+   for (int i=0; i<4; i++)
+      v |= (unsigned int)get_byte(at) << (i*8);
+
+   return (int)v;
+}
+
+static void put_state(ent_state *s)
+{
+   put_int(s->x);
+   put_int(s->y);
+   put_byte(s->direction);
+   put_byte(s->plan);
+}
+
+static void get_state(unsigned long *at, ent_state *s)
+{
+   s->x = get_int(at);
+   s->y = get_int(at);
+   s->direction = get_byte(at);
+   s->plan = get_byte(at);
+}
+
+static rewind_frame *frame(unsigned long tick)
+{
+   return &frames[tick % REWIND_FRAMES];
+}
+
+   /* drop the oldest full copy and the ticks that build on it */
+static void drop_oldest()
+{
+   do
+      first_frame++;
+   while (first_frame<next_frame && !frame(first_frame)->key);
+
+   byte_head = first_frame<next_frame ? frame(first_frame)->at : byte_tail;
+}
+
+   /* bring state from what it was one frame before up to fr */
+static void read_frame(rewind_frame *fr, ent_state *state)
+{
+   unsigned long at = fr->at;
+
+   for (int i=0; i<ent_count; i++)
+   {
+      if (fr->key){
+         get_state(&at, &state[i]);
+         continue;
+      }
+
+      unsigned char b = get_byte(&at);
+
+      if (b==0)
+         get_state(&at, &state[i]);
+      else{
+         state[i].x += (b>>4) - 8;
+         state[i].y += (b&15) - 8;
+      }
+   }
+}
+
+   /* put the game as state and fr say, fr's eaten log included */
+static void apply(ent_state *state, rewind_frame *fr)
+{
+   for (int i=0; i<ent_count; i++)
+   {
+      entity *ent = ents[i];
+
+      hold_tile(ent, false);
+
+      ent->x = ent->prev_x = state[i].x;
+      ent->y = ent->prev_y = state[i].y;
+      ent->direction = state[i].direction;
+      ent->plan = state[i].plan;
+      ent->think = 0;
+
+      hold_tile(ent, true);
+   }
+
+   losses = fr->losses;
+   has_won = fr->has_won;
+   previous_dir = fr->previous_dir;
+   next_turn = fr->next_turn;
+   died_at = fr->died_at;
+   ai_tick = fr->ai_tick;
+
+   while (eaten_count>fr->eaten)
+   {
+      eaten_count--;
+      tile_at(eaten[eaten_count]%width, eaten[eaten_count]/width).type = 'o';
+      pellet_set(eaten[eaten_count]%width, eaten[eaten_count]/width);   //packets comes back with it
+   }
+}
+
+void rewind_start()
+{
+   free_rewind();
+
+   for (entity *ent=entity_list; ent!=NULL; ent=ent->next)
+      ent_count++;
+
+   if (ent_count==0)
+      return;
+
+   ents = (entity **) level_alloc(ent_count*sizeof(entity *));
+   start = (ent_state *) level_alloc(ent_count*sizeof(ent_state));
+   last = (ent_state *) level_alloc(ent_count*sizeof(ent_state));
+   scratch = (ent_state *) level_alloc(ent_count*sizeof(ent_state));
+
+      /* every tick as one byte an entity with room to spare, and the full copies */
+   byte_room = (unsigned long)ent_count*(2*REWIND_FRAMES + 10*(REWIND_FRAMES/REWIND_KEY_EVERY+2)) + 64;
+   bytes = (unsigned char *) level_alloc(byte_room);
+
+   int i = 0;
+   for (entity *ent=entity_list; ent!=NULL; ent=ent->next, i++){
+      ents[i] = ent;
+      start[i].x = ent->x;
+      start[i].y = ent->y;
+      start[i].direction = ent->direction;
+      start[i].plan = ent->plan;
+   }
+
+   rewind_record();
+   start_frame = *frame(0);
+}
+
+void rewind_record()
+{
+   if (ents==NULL)
+      return;
+
+   if (next_frame-first_frame==REWIND_FRAMES)
+      drop_oldest();
+
+      /* worst case, every entity as a 0 and a full copy */
+   while (first_frame<next_frame && byte_room-(byte_tail-byte_head) < (unsigned long)ent_count*11)
+      drop_oldest();
+
+   rewind_frame *fr = frame(next_frame);
+
+   fr->at = byte_tail;
+   fr->key = first_frame==next_frame || next_frame-last_key>=REWIND_KEY_EVERY;
+   fr->losses = losses;
+   fr->has_won = has_won;
+   fr->previous_dir = previous_dir;
+   fr->next_turn = next_turn;
+   fr->died_at = died_at;
+   fr->ai_tick = ai_tick;
+   fr->eaten = eaten_count;
+
+   for (int i=0; i<ent_count; i++)
+   {
+      ent_state now = { ents[i]->x, ents[i]->y, ents[i]->direction, ents[i]->plan };
+      int dx = now.x - last[i].x;
+      int dy = now.y - last[i].y;
+
+      if (fr->key)
+         put_state(&now);
+      else if (now.direction==last[i].direction && now.plan==last[i].plan && dx>-8 && dx<8 && dy>-8 && dy<8)
+         put_byte((dx+8)<<4 | (dy+8));
+      else{
+         put_byte(0);
+         put_state(&now);
+      }
+
+      last[i] = now;
+   }
+
+   if (fr->key)
+      last_key = next_frame;
+   next_frame++;
+
+   frames_recorded++;
+   bytes_recorded += byte_tail - fr->at;
+   full_bytes += 10*ent_count;
+}
+
+void rewind_eaten(int x, int y)
+{
+   if (ents==NULL)
+      return;
+
+   if (eaten_count==eaten_room){
+      eaten = (int *) level_grow(eaten, eaten_room*sizeof(int), (eaten_room ? eaten_room*2 : 256)*sizeof(int));
+      eaten_room = eaten_room ? eaten_room*2 : 256;
+   }
+
+   eaten[eaten_count++] = y*width + x;
+}
+
+unsigned int rewind_back(unsigned int ticks)
+{
+   if (next_frame==first_frame)
+      return 0;
+
+   unsigned int n = std::min((unsigned long)ticks, next_frame-1-first_frame);
+   unsigned long target = next_frame-1-n;
+   unsigned long key = target;
+
+   while (!frame(key)->key)
+      key--;
+
+   for (unsigned long t=key; t<=target; t++)
+      read_frame(frame(t), scratch);
+
+   apply(scratch, frame(target));
+
+      /* whatever happens now is recorded over the ticks after */
+   if (n)
+      byte_tail = frame(target+1)->at;
+   next_frame = target+1;
+   last_key = key;
+   memcpy(last, scratch, ent_count*sizeof(ent_state));
+
+   rewinds++;
+   return n;
+}
+
+void rewind_restart()
+{
+   if (ents==NULL)
+      return;
+
+   apply(start, &start_frame);
+
+   first_frame = next_frame = last_key = 0;
+   byte_head = byte_tail = 0;
+
+   rewinds++;
+   rewind_record();
+}
+
+unsigned int rewind_kept()
+{
+   return next_frame>first_frame ? next_frame-1-first_frame : 0;
+}
+
+int rewind_eaten_log(const int **tiles)
+{
+   *tiles = eaten;
+   return eaten_count;
+}
+
+void free_rewind()
+{
+   ents = NULL;
+   start = last = scratch = NULL;
+   bytes = NULL;
+   eaten = NULL;
+
+   ent_count = 0;
+   eaten_count = eaten_room = 0;
+   byte_room = byte_head = byte_tail = 0;
+   first_frame = next_frame = last_key = 0;
+}
+
+void print_rewind_stats()
+{
+   if (frames_recorded==0)
+      return;
+
+   printf("rewind: %ld ticks recorded, %.1f bytes a tick (%.1f as full copies), %ld rewinds\n",
+      frames_recorded, (double)bytes_recorded/frames_recorded, (double)full_bytes/frames_recorded, rewinds);
+}
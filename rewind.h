@@ -0,0 +1,40 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include "packman.h"
+
+/*
+ *  Rewinding the game.
+ *
+ *  Every tick of the simulation goes into a ring of the last REWIND_FRAMES
+ *  ticks: the counters and buffered turn, and where every entity is and
+ *  which way it goes. The tiles entities hold follow from that, see
+ *  held_tile(). Every REWIND_KEY_EVERY ticks that is a full copy, in
+ *  between only a byte per entity for how far it moved since the tick
+ *  before. Pellets are a log of
+ *  every one eaten this level, each tick only remembers how long the log was.
+ *
+ *  Going back is a full copy and at most REWIND_KEY_EVERY-1 ticks of bytes
+ *  forward from it, plus putting back the pellets eaten since. The ticks after
+ *  the one gone back to are dropped, whatever happens next is recorded over
+ *  them. The level's start is always kept, rewind_restart() goes back to it.
+ *
+ *  Only the simulation side uses it, or anything else while that is stopped.
+ */
+
+   /* ticks kept, about ten seconds of play */
+#define REWIND_FRAMES 512
+   /* a full copy every this many ticks */
+#define REWIND_KEY_EVERY 32
+
+void rewind_start();   /* level loaded, start recording from here */
+void rewind_record();   /* after every move_entities */
+void rewind_eaten(int x, int y);   /* a pellet at x,y was just eaten */
+unsigned int rewind_back(unsigned int ticks);   /* go back up to ticks, returns how many it went */
+void rewind_restart();   /* back to how the level started */
+unsigned int rewind_kept();   /* ticks that can be gone back */
+int rewind_eaten_log(const int **tiles);   /* pellets eaten this level as y*width+x, returns how many */
+void free_rewind();   /* forget the level, before its arena is reset */
+void print_rewind_stats();
+
+#endif
@@ -0,0 +1,351 @@
+/*
+ * Lookahead AI, see search.h.
+ *
+ *   Flat Monte-Carlo: no tree, just rollouts handed out evenly over the ways
+ *   out of each junction. The guessed player keeps going from where it is
+ *   heading, turning at random at junctions, at the player's speed, and stays
+ *   put if it is standing still. Chasers mostly walk down a walking distance
+ *   map around the player, fleers wander. A rollout scores the step the two
+ *   met on, or if they never did SEARCH_DEPTH plus how far off the entity
+ *   ended up. Chasers take the way with the lowest average, fleers the highest.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "search.h"
+#include "kinds.h"
+#include "arena.h"
+
+unsigned int search_budget = 0;
+long search_rollouts = 0;
+
+struct search_job
+{
+   int x;   /* the junction being searched for */
+   int y;
+   bool flee;
+   int speed;   /* of the searching entity, pixels per tick */
+
+   long total[5];   /* summed rollout scores for each way out */
+   int runs[5];
+   int next;   /* way out the next rollout takes */
+
+   unsigned int seen;   /* last search_think that wanted this job */
+};
+
+   /* anything walking the corridors in a rollout */
+struct walker
+{
+   int x;
+   int y;
+   int dir;
+};
+
+static const int step_x[5] = { 0, 0, -1, 1, 0 };
+static const int step_y[5] = { 0, -1, 0, 0, 1 };
+
+static unsigned int search_frame = 0;
+static unsigned int search_seed = 1;
+
+static search_job **active = NULL;
+static int active_room = 0;
+
+   /* walking distance to the player, for tiles within SEARCH_RADIUS of it this frame */
+static int *near_dist = NULL;
+static unsigned int *near_stamp = NULL;
+static int *near_queue = NULL;
+static int near_size = 0;
+
+static unsigned int next_rand()
+{
+   /* xorshift32, so games play out the same every time */
+   unsigned int x = search_seed;
+   x ^= x << 13;
+   x ^= x >> 17;
+   x ^= x << 5;
+   search_seed = x;
+   return x;
+}
+
+static bool open_way(int x, int y, int dir)
+{
+   return tile_at(x+step_x[dir], y+step_y[dir]).type!='#';
+}
+
+static int exits(int x, int y)
+{
+   return open_way(x,y,1) + open_way(x,y,2) + open_way(x,y,3) + open_way(x,y,4);
+}
+
+   /* one tile on, turning at random at junctions, back only at dead ends */
+static void walk(walker *w)
+{
+   int ways[4];
+   int n = 0;
+
+   for (int dir=1; dir<=4; dir++)
+      if (dir!=5-w->dir && open_way(w->x, w->y, dir))
+         ways[n++] = dir;
+
+   if (n==0){
+      if (w->dir==0 || !open_way(w->x, w->y, 5-w->dir))
+         return;
+      w->dir = 5-w->dir;
+   }
+   else
+      w->dir = n==1 ? ways[0] : ways[next_rand()%n];
+
+   w->x += step_x[w->dir];
+   w->y += step_y[w->dir];
+}
+
+   /* walking distance from x,y to where the player was this frame, big if too far to know */
+static int player_dist(int x, int y)
+{
+   int i = y*width + x;
+
+   return near_stamp[i]==search_frame ? near_dist[i] : SEARCH_RADIUS+1;
+}
+
+   /* breadth first out from the player's next tile, SEARCH_RADIUS tiles deep */
+static void flood_player(int x, int y)
+{
+   int head = 0, tail = 0;
+
+   near_stamp[y*width+x] = search_frame;
+   near_dist[y*width+x] = 0;
+   near_queue[tail++] = y*width+x;
+
+   while (head<tail)
+   {
+      int i = near_queue[head++];
+
+      if (near_dist[i]>=SEARCH_RADIUS)
+         continue;
+
+      for (int dir=1; dir<=4; dir++)
+      {
+         int nx = i%width + step_x[dir];
+         int ny = i/width + step_y[dir];
+         int n = ny*width + nx;
+
+         if (near_stamp[n]==search_frame || tile_at(nx,ny).type=='#')
+            continue;
+
+         near_stamp[n] = search_frame;
+         near_dist[n] = near_dist[i]+1;
+         near_queue[tail++] = n;
+      }
+   }
+}
+
+   /* like walk, but at junctions mostly take the way that gets nearest the player */
+static void walk_towards(walker *w)
+{
+   if (next_rand()%4==0){
+      walk(w);
+      return;
+   }
+
+   int best = 0;
+   int best_dist = 0;
+
+   for (int dir=1; dir<=4; dir++)
+   {
+      if (dir==5-w->dir || !open_way(w->x, w->y, dir))
+         continue;
+
+      int dist = player_dist(w->x+step_x[dir], w->y+step_y[dir]);
+
+      if (best==0 || dist<best_dist){
+         best = dir;
+         best_dist = dist;
+      }
+   }
+
+   if (best==0){
+      walk(w);
+      return;
+   }
+
+   w->dir = best;
+   w->x += step_x[w->dir];
+   w->y += step_y[w->dir];
+}
+
+   /* play out the job's entity leaving its junction by way dir, see the top */
+static long rollout(search_job *job, int dir)
+{
+   walker e = { job->x+step_x[dir], job->y+step_y[dir], dir };
+   walker p;
+   int catchup = 0;
+
+   tile_ahead(player, &p.x, &p.y);
+   p.dir = player->direction;
+
+   for (int step=1; step<=SEARCH_DEPTH; step++)
+   {
+      if (step>1){
+         if (job->flee)
+            walk(&e);
+         else
+            walk_towards(&e);
+      }
+
+      for (catchup += kind_traits<KIND_PLAYER>::speed; catchup>=job->speed; catchup -= job->speed)
+      {
+         if (e.x==p.x && e.y==p.y)
+            return step;
+         if (p.dir!=0)
+            walk(&p);
+      }
+      if (e.x==p.x && e.y==p.y)
+         return step;
+   }
+
+   return SEARCH_DEPTH + player_dist(e.x, e.y);
+}
+
+   /* give every entity of kind K that is heading for a junction a job for it */
+template<int K>
+int gather(int n)
+{
+   if (kind_traits<K>::steering==STEER_KEYS)
+      return n;
+
+   for (int i=0; i<kind_count[K]; i++)
+   {
+      entity *ent = kind_batch[K][i];
+      int x, y;
+
+      if (!entity_awake(ent) || tile_ahead(ent, &x, &y)>16 || exits(x,y)<3)
+         continue;
+
+      if (ent->job==NULL)
+         ent->job = (search_job *) level_alloc(sizeof(search_job));
+
+      search_job *job = ent->job;
+
+         /* a new junction, or the same one on a later visit */
+      if (job->x!=x || job->y!=y || job->seen!=search_frame-1){
+         memset(job, 0, sizeof(search_job));
+         job->x = x;
+         job->y = y;
+         job->flee = kind_traits<K>::steering==STEER_FLEE;
+         job->speed = kind_traits<K>::speed;
+      }
+      else{
+            /* the player has moved on, older rollouts count for less */
+         for (int dir=1; dir<=4; dir++){
+            int runs = (job->runs[dir]+1)/2;
+
+            if (job->runs[dir])
+               job->total[dir] = job->total[dir]*runs/job->runs[dir];
+            job->runs[dir] = runs;
+         }
+      }
+      job->seen = search_frame;
+
+      if (n==active_room){
+         active = (search_job **) level_grow(active, active_room*sizeof(search_job *),
+            (active_room ? active_room*2 : 64)*sizeof(search_job *));
+         active_room = active_room ? active_room*2 : 64;
+      }
+      active[n++] = job;
+   }
+
+   return n;
+}
+
+/*
+ *   Run rollouts round the jobs, one way out at a time, until usec is up.
+ *   The clock is only read every few rollouts.
+ */
+void search_think(unsigned int usec)
+{
+   search_frame++;
+
+   if (usec==0 || player==NULL || (long)width*height>SEARCH_MAX_TILES)
+      return;
+
+   Uint64 end = usec_now() + usec;
+   int n = 0;
+   int px, py;
+
+   if (near_size!=width*height){
+      near_size = width*height;
+      near_dist = (int *) level_alloc(near_size*sizeof(int));
+      near_stamp = (unsigned int *) level_alloc(near_size*sizeof(unsigned int));
+      near_queue = (int *) level_alloc(near_size*sizeof(int));
+   }
+
+   tile_ahead(player, &px, &py);
+   flood_player(px, py);
+
+   n = gather<KIND_ENEMY>(n);
+   n = gather<KIND_SNITCH>(n);
+   n = gather<KIND_PLAYER>(n);
+
+   if (n==0)
+      return;
+
+   for (int i=0; usec_now()<end; )
+   {
+      for (int r=0; r<16; r++, i=(i+1)%n)
+      {
+         search_job *job = active[i];
+
+         do
+            job->next = job->next%4 + 1;
+         while (!open_way(job->x, job->y, job->next));
+
+         job->total[job->next] += rollout(job, job->next);
+         job->runs[job->next]++;
+         search_rollouts++;
+      }
+   }
+}
+
+int search_choice(entity *ent, int x, int y)
+{
+   search_job *job = ent->job;
+   int best = 0;
+   double best_score = 0;
+
+   if (job==NULL || job->x!=x || job->y!=y || job->seen!=search_frame)
+      return 0;
+
+   for (int dir=1; dir<=4; dir++)
+   {
+      if (!open_way(x, y, dir))
+         continue;
+
+         /* not every way tried yet, nothing to go on */
+      if (job->runs[dir]==0)
+         return 0;
+
+      double score = (double)job->total[dir]/job->runs[dir];
+
+      if (best==0 || (job->flee ? score>best_score : score<best_score)){
+         best = dir;
+         best_score = score;
+      }
+   }
+
+   return best;
+}
+
+void free_search()
+{
+   for (entity *ent=entity_list; ent!=NULL; ent=ent->next)
+      ent->job = NULL;
+
+   active = NULL;
+   active_room = 0;
+
+   near_dist = NULL;
+   near_stamp = NULL;
+   near_queue = NULL;
+   near_size = 0;
+}
@@ -0,0 +1,31 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "packman.h"
+
+/*
+ *  Lookahead AI for enemies and the snitch, off unless search_budget is set.
+ *
+ *  Every entity heading for a junction gets a search job for that junction.
+ *  search_think() spends its time on random rollouts of those jobs: the
+ *  entity takes one way out, then both it and a guessed player walk the
+ *  corridors for SEARCH_DEPTH tiles. Each way out keeps a running score that
+ *  fades as the player moves on, so whenever the entity gets there the best
+ *  way so far is ready to take. Until every way has a score calc_path decides.
+ */
+
+   /* rollout length, in tiles walked by the searching entity */
+#define SEARCH_DEPTH 48
+   /* how far out from the player rollouts know the way to it */
+#define SEARCH_RADIUS 64
+   /* no lookahead on levels bigger than this, the distance table would not pay */
+#define SEARCH_MAX_TILES (1<<22)
+
+extern unsigned int search_budget;   /* microseconds of rollouts a frame, 0 for calc_path only */
+extern long search_rollouts;   /* rollouts run, for stats */
+
+void search_think(unsigned int usec);   /* once a frame, before moving */
+int search_choice(entity *ent, int x, int y);   /* best way out of junction x,y so far, 0 if none yet */
+void free_search();   /* forget every job, before the level's arena is reset */
+
+#endif
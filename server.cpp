@@ -0,0 +1,512 @@
+/*
+ * Game server, see server.h.
+ *
+ *   One thread does it all: take new clients, read what they sent, tick, send.
+ *   Sockets are non-blocking and whatever a client cannot take yet waits in
+ *   its out buffer. history[] has every entity as of each of the last
+ *   SERVE_HISTORY ticks, by tick modulo SERVE_HISTORY, next to how long the
+ *   eaten log (rewind_eaten_log) was then.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <algorithm>
+
+#include "server.h"
+#include "input.h"
+#include "search.h"
+#include "rewind.h"
+#include "arena.h"
+#include "assets.h"
+
+struct serve_client
+{
+   int fd;
+   uint32_t acked;   /* SERVE_FULL until it acks a tick still in history */
+
+   unsigned char in[8];   /* a message read in part */
+   int in_have;
+
+   char *out;
+   size_t out_len;
+   size_t out_room;
+};
+
+   /* one tick's state, encoded once for every client with that base */
+struct serve_encoded
+{
+   uint32_t base;
+   size_t at;   /* in encoded */
+   size_t len;
+};
+
+static int listen_fd = -1;
+static volatile sig_atomic_t serve_stop = 0;
+
+static serve_client *clients = NULL;
+static int client_count = 0;
+static int client_room = 0;
+
+static uint32_t tick = 0;   /* ticks served, over every level */
+static int ent_count = 0;
+static serve_entity *history = NULL;   /* SERVE_HISTORY ticks of ent_count, from the level arena */
+static uint32_t history_tick[SERVE_HISTORY];
+static int history_eaten[SERVE_HISTORY];
+
+static char *level_msg = NULL;   /* the serve_level of the level being played */
+static size_t level_len = 0;
+static size_t biggest_msg = 0;   /* longest ever appended, for the backlog cap */
+
+static char *encoded = NULL;
+static size_t encoded_len = 0;
+static size_t encoded_room = 0;
+static serve_encoded *states = NULL;
+static int state_count = 0;
+static int state_room = 0;
+
+   /* for the stats printed at the end */
+static long ticks_served = 0;
+static long clients_seen = 0;
+static long states_sent = 0;
+static long states_encoded = 0;
+static long full_sent = 0;
+static uint64_t bytes_sent = 0;
+
+static void stop_serving(int sig)
+{
+   serve_stop = 1;
+}
+
+static bool grow(void **mem, size_t *room, size_t need, size_t size)
+{
+   if (need<=*room)
+      return true;
+
+   size_t bigger = std::max(need, *room*2);
+   void *more = realloc(*mem, bigger*size);
+
+   if (more==NULL)
+      return false;
+
+   *mem = more;
+   *room = bigger;
+   return true;
+}
+
+   /* queue bytes for a client, false if it is too far behind to keep */
+static bool append(serve_client *client, const void *data, size_t len)
+{
+   biggest_msg = std::max(biggest_msg, len);
+
+   if (client->out_len+len > std::max((size_t)SERVE_BACKLOG, 2*biggest_msg)
+      || !grow((void **)&client->out, &client->out_room, client->out_len+len, 1))
+      return false;
+
+   memcpy(client->out+client->out_len, data, len);
+   client->out_len += len;
+
+   return true;
+}
+
+   /* send what the client takes, false if it is gone */
+static bool flush(serve_client *client)
+{
+   size_t sent = 0;
+
+   while (sent<client->out_len)
+   {
+      ssize_t n = send(client->fd, client->out+sent, client->out_len-sent, MSG_NOSIGNAL|MSG_DONTWAIT);
+
+      if (n<0 && (errno==EAGAIN || errno==EWOULDBLOCK))
+         break;
+      if (n<0 && errno==EINTR)
+         continue;
+      if (n<=0)
+         return false;
+
+      sent += n;
+   }
+
+   memmove(client->out, client->out+sent, client->out_len-sent);
+   client->out_len -= sent;
+   bytes_sent += sent;
+
+   return true;
+}
+
+static void drop_client(int i)
+{
+   close(clients[i].fd);
+   free(clients[i].out);
+
+   clients[i] = clients[--client_count];
+}
+
+static bool in_history(uint32_t t)
+{
+   return t<=tick && tick-t<SERVE_HISTORY && history_tick[t%SERVE_HISTORY]==t;
+}
+
+   /* every entity as of now into history */
+static void record_tick()
+{
+   serve_entity *now = history + (size_t)(tick%SERVE_HISTORY)*ent_count;
+   const int *tiles;
+   int i = 0;
+
+   for (entity *ent=entity_list; ent!=NULL && i<ent_count; ent=ent->next, i++){
+      memset(&now[i], 0, sizeof(serve_entity));
+      now[i].index = i;
+      now[i].x = ent->x;
+      now[i].y = ent->y;
+      now[i].type = ent->type;
+      now[i].direction = ent->direction;
+   }
+
+   history_tick[tick%SERVE_HISTORY] = tick;
+   history_eaten[tick%SERVE_HISTORY] = rewind_eaten_log(&tiles);
+}
+
+   /* now as against base, encoded at most once a tick */
+static serve_encoded *encode(uint32_t base)
+{
+   for (int i=0; i<state_count; i++)
+      if (states[i].base==base)
+         return &states[i];
+
+   size_t room = state_room;
+   const int *tiles;
+   int eaten = rewind_eaten_log(&tiles);
+   int from = base==SERVE_FULL ? 0 : history_eaten[base%SERVE_HISTORY];
+   size_t most = sizeof(serve_state) + ent_count*sizeof(serve_entity) + (eaten-from)*sizeof(int32_t);
+
+   if (!grow((void **)&states, &room, state_count+1, sizeof(serve_encoded))
+      || !grow((void **)&encoded, &encoded_room, encoded_len+most, 1))
+      return NULL;
+   state_room = room;
+
+   serve_encoded *state = &states[state_count++];
+   serve_state *head = (serve_state *) (encoded+encoded_len);
+   serve_entity *now = history + (size_t)(tick%SERVE_HISTORY)*ent_count;
+   serve_entity *then = base==SERVE_FULL ? NULL : history + (size_t)(base%SERVE_HISTORY)*ent_count;
+   size_t at = encoded_len + sizeof(serve_state);
+
+   state->base = base;
+   state->at = encoded_len;
+
+   memset(head, 0, sizeof(serve_state));
+   head->type = SERVE_STATE;
+   head->tick = tick;
+   head->base = base;
+   head->packets = packets;
+   head->losses = losses;
+   head->has_won = has_won;
+
+   for (int i=0; i<ent_count; i++)
+   {
+      if (then!=NULL && memcmp(&now[i], &then[i], sizeof(serve_entity))==0)
+         continue;
+
+      memcpy(encoded+at, &now[i], sizeof(serve_entity));
+      at += sizeof(serve_entity);
+      head->changed++;
+   }
+
+   for (int i=from; i<eaten; i++){
+      int32_t tile = tiles[i];
+      memcpy(encoded+at, &tile, sizeof(tile));
+      at += sizeof(tile);
+   }
+   head->eaten = eaten-from;
+
+   state->len = at-encoded_len;
+   encoded_len = at;
+   states_encoded++;
+
+   return state;
+}
+
+   /* a level was just loaded: start its history and tell everyone */
+static bool start_level()
+{
+   serve_level head;
+   size_t tiles = (size_t)width*height;
+
+   ent_count = 0;
+   for (entity *ent=entity_list; ent!=NULL; ent=ent->next)
+      ent_count++;
+
+   history = (serve_entity *) level_alloc((size_t)SERVE_HISTORY*std::max(ent_count,1)*sizeof(serve_entity));
+   memset(history_tick, 0xFF, sizeof(history_tick));
+   record_tick();
+
+   memset(&head, 0, sizeof(head));
+   head.type = SERVE_LEVEL;
+   head.level = level;
+   head.width = width;
+   head.height = height;
+   head.entities = ent_count;
+
+   level_len = sizeof(head) + ((tiles+3) & ~(size_t)3);
+   free(level_msg);
+   if ((level_msg = (char *) calloc(level_len, 1))==NULL){
+      printf("\nout of memory for the level message\n");
+      return false;
+   }
+
+   memcpy(level_msg, &head, sizeof(head));
+   for (int y=0; y<height; y++)
+      for (int x=0; x<width; x++)
+         level_msg[sizeof(head) + (size_t)y*width + x] = tile_at(x,y).type;
+
+   for (int i=0; i<client_count; i++){
+      clients[i].acked = SERVE_FULL;
+      if (!append(&clients[i], level_msg, level_len))
+         drop_client(i--);
+   }
+
+   return true;
+}
+
+   /* the level is over, on to the next or back to the first */
+static bool next_level(char *first_level)
+{
+   char text[32];
+   bool lost = losses>=deaths_to_lose;
+
+   cleanuplvl();
+   packets = 0;
+   has_won = 0;
+
+   if (lost){
+      losses = 0;
+      level = 0;
+   }
+   else{
+      level++;
+      snprintf(text, 32, "levels/level%d", level);
+      if (access(data_path(text), R_OK)==0 && load_lvl(text,(char *)"assets/walls_small.png",(char *)"assets/background.png"))
+         return start_level();
+
+         /* no more levels, round again */
+      cleanuplvl();
+      packets = 0;
+      level = 0;
+   }
+
+   if (!load_lvl(first_level,(char *)"assets/walls_small.png",(char *)"assets/background.png"))
+      return false;
+
+   return start_level();
+}
+
+static bool open_socket(const char *where)
+{
+   bool port = where[0]!='\0' && strspn(where, "0123456789")==strlen(where);
+
+   if (port){
+      struct sockaddr_in addr;
+      int yes = 1;
+
+      memset(&addr, 0, sizeof(addr));
+      addr.sin_family = AF_INET;
+      addr.sin_port = htons(atoi(where));
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+      listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+      if (listen_fd!=-1)
+         setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+      if (listen_fd==-1 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr))==-1){
+         printf("\ncould not listen on 127.0.0.1:%s\n", where);
+         return false;
+      }
+   }
+   else{
+      struct sockaddr_un addr;
+
+      if (strlen(where)>=sizeof(addr.sun_path)){
+         printf("\nsocket path %s is too long\n", where);
+         return false;
+      }
+
+      memset(&addr, 0, sizeof(addr));
+      addr.sun_family = AF_UNIX;
+      strcpy(addr.sun_path, where);
+      unlink(where);
+
+      listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+      if (listen_fd==-1 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr))==-1){
+         printf("\ncould not listen on %s\n", where);
+         return false;
+      }
+   }
+
+   if (listen(listen_fd, 16)==-1 || fcntl(listen_fd, F_SETFL, O_NONBLOCK)==-1){
+      printf("\ncould not listen on %s\n", where);
+      return false;
+   }
+
+   printf("serving on %s%s\n", port ? "127.0.0.1:" : "", where);
+   return true;
+}
+
+static void accept_clients()
+{
+   int fd;
+
+   while ((fd = accept(listen_fd, NULL, NULL))!=-1)
+   {
+      size_t room = client_room;
+
+      if (fcntl(fd, F_SETFL, O_NONBLOCK)==-1 || !grow((void **)&clients, &room, client_count+1, sizeof(serve_client))){
+         close(fd);
+         continue;
+      }
+      client_room = room;
+
+      serve_client *client = &clients[client_count++];
+
+      memset(client, 0, sizeof(serve_client));
+      client->fd = fd;
+      client->acked = SERVE_FULL;
+      clients_seen++;
+
+      if (!append(client, level_msg, level_len))
+         drop_client(client_count-1);
+   }
+}
+
+   /* keys and acks from every client, false if the client is gone */
+static bool read_client(serve_client *client)
+{
+   unsigned char buf[512];
+   ssize_t n;
+
+   while ((n = recv(client->fd, buf, sizeof(buf), MSG_DONTWAIT))>0)
+   {
+      for (ssize_t i=0; i<n; i++)
+      {
+         client->in[client->in_have++] = buf[i];
+         if (client->in_have<8)
+            continue;
+         client->in_have = 0;
+
+         int32_t type, value;
+         memcpy(&type, client->in, 4);
+         memcpy(&value, client->in+4, 4);
+
+         if (type==SERVE_KEY && (value&255)>=1 && (value&255)<=4)
+            push_input(value&255, (value&256)!=0);
+         else if (type==SERVE_ACK)
+            client->acked = in_history(value) ? (uint32_t)value : SERVE_FULL;
+      }
+   }
+
+   return n<0 && (errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR);
+}
+
+   /* this tick to every client that has taken everything before it */
+static void send_states()
+{
+   encoded_len = 0;
+   state_count = 0;
+
+   for (int i=0; i<client_count; i++)
+   {
+      serve_client *client = &clients[i];
+
+      if (client->out_len==0){
+         uint32_t base = in_history(client->acked) ? client->acked : SERVE_FULL;
+         serve_encoded *state = encode(base);
+
+         if (state==NULL || !append(client, encoded+state->at, state->len)){
+            drop_client(i--);
+            continue;
+         }
+
+         states_sent++;
+         if (base==SERVE_FULL)
+            full_sent++;
+      }
+
+      if (!flush(client))
+         drop_client(i--);
+   }
+}
+
+int run_server(const char *where, char *first_level, int rate)
+{
+   if (!open_socket(where) || !start_level())
+      return 1;
+
+   signal(SIGINT, stop_serving);
+   signal(SIGTERM, stop_serving);
+
+   Uint64 next = usec_now();
+
+   while (!serve_stop)
+   {
+      accept_clients();
+
+      for (int i=0; i<client_count; i++)
+         if (!read_client(&clients[i]))
+            drop_client(i--);
+
+      drain_input();
+      stream_chunks();
+      search_think(search_budget);
+      move_entities(1);
+
+      tick++;
+      ticks_served++;
+      record_tick();
+
+      if ((packets<=0 || has_won || losses>=deaths_to_lose) && !next_level(first_level))
+         break;
+
+      send_states();
+
+         /* on to the next tick, starting the schedule over after a stall */
+      if (rate>0){
+         Uint64 now = usec_now();
+
+         next += 1000000/rate;
+         if (next>now)
+            usleep(next-now);
+         else if (now-next > 100000)
+            next = now;
+      }
+   }
+
+   for (int i=client_count-1; i>=0; i--)
+      drop_client(i);
+   close(listen_fd);
+   listen_fd = -1;
+   if (strspn(where, "0123456789")!=strlen(where))
+      unlink(where);
+
+   printf("served %ld ticks to %ld clients: %ld states, %ld of them whole, %ld encoded, %.1f bytes a state\n",
+      ticks_served, clients_seen, states_sent, full_sent, states_encoded,
+      states_sent ? (double)bytes_sent/states_sent : 0.0);
+
+   free(clients);
+   free(level_msg);
+   free(encoded);
+   free(states);
+   clients = NULL;
+   level_msg = NULL;
+   encoded = NULL;
+   states = NULL;
+   client_count = client_room = 0;
+   encoded_room = 0;
+   state_room = 0;
+
+   return serve_stop ? 0 : 1;
+}
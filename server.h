@@ -0,0 +1,81 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+
+#include "packman.h"
+
+/*
+ *  Running the game for others, 'Packman serve <socket> [ticks a second]'.
+ *
+ *  No window: the level is simulated with move_entities like always and any
+ *  number of clients connect to a Unix socket at <socket>, or to 127.0.0.1 if
+ *  <socket> is a port number. Every client may steer the player and gets the
+ *  game every tick. Levels go on like in the game, losing starts over from
+ *  the first one.
+ *
+ *  Everything is little endian int32s. A client sends 8 byte messages:
+ *
+ *    SERVE_KEY   direction | 256 if pressed, 0 if let go
+ *    SERVE_ACK   the newest tick it has
+ *
+ *  and gets a serve_level when it connects and whenever a level starts,
+ *  then serve_states. A state only has the entities that changed since the
+ *  tick the client last acked and the pellets eaten since, so it is the acked
+ *  tick's state plus what is in the message. Until it acks, or if its ack is
+ *  more than SERVE_HISTORY ticks old, base is SERVE_FULL and the message has
+ *  every entity and every pellet eaten this level. A client that has not
+ *  taken everything sent to it yet skips ticks, the next state it gets covers
+ *  them. All clients with the same base share one encoded message.
+ */
+
+   /* ticks of entity states kept to send deltas against */
+#define SERVE_HISTORY 128
+   /* bytes a client may have unread before it is dropped, or twice the
+      biggest message sent if that is more, so a level message or a full
+      state of a huge level can always be queued behind another */
+#define SERVE_BACKLOG (1<<20)
+
+#define SERVE_KEY 'K'
+#define SERVE_ACK 'A'
+#define SERVE_LEVEL 'L'
+#define SERVE_STATE 'S'
+
+#define SERVE_FULL 0xFFFFFFFFu
+
+struct serve_level
+{
+   int32_t type;   /* SERVE_LEVEL */
+   int32_t level;
+   int32_t width;
+   int32_t height;
+   int32_t entities;
+      /* then width*height tile types, row by row, padded to 4 bytes */
+};
+
+struct serve_state
+{
+   int32_t type;   /* SERVE_STATE */
+   uint32_t tick;   /* ticks served, levels before included */
+   uint32_t base;   /* the tick it builds on, SERVE_FULL for none */
+   int32_t packets;
+   int32_t losses;
+   int32_t has_won;
+   int32_t changed;
+   int32_t eaten;
+      /* then changed serve_entitys and eaten tiles as y*width+x */
+};
+
+struct serve_entity
+{
+   int32_t index;   /* in entity_list */
+   int32_t x;
+   int32_t y;
+   char type;
+   char direction;
+   char pad[2];
+};
+
+int run_server(const char *where, char *first_level, int rate);   /* returns 0 once stopped with ctrl-c */
+
+#endif
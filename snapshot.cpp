@@ -0,0 +1,113 @@
+/*
+ * Triple buffered snapshots, see snapshot.h.
+ *
+ *   snap_middle holds the index of the last published snapshot, with
+ *   SNAP_FRESH set until the render side has taken it. The simulation side
+ *   owns snap_back and the render side snap_front; each swaps its own with
+ *   the middle one and nothing else is shared.
+ */
+
+#include <string.h>
+
+#include "snapshot.h"
+
+#define SNAP_FRESH 4
+
+static snapshot snaps[3];
+
+static int snap_back = 0;
+static int snap_middle = 1;
+static int snap_front = 2;
+
+void reset_snapshots()
+{
+   for (int i=0; i<3; i++)
+      snaps[i].ready = false;
+
+   snap_back = 0;
+   snap_middle = 1;
+   snap_front = 2;
+}
+
+void free_snapshots()
+{
+   for (int i=0; i<3; i++){
+      free(snaps[i].ents);
+      free(snaps[i].types);
+      free(snaps[i].tvalues);
+      free(snaps[i].pellets);
+      memset(&snaps[i], 0, sizeof(snapshot));
+   }
+
+   reset_snapshots();
+}
+
+snapshot *begin_snapshot(int count, int tiles, int blocks)
+{
+   snapshot *snap = &snaps[snap_back];
+
+   if (count>snap->ent_room){
+      snap->ent_room = count;
+      snap->ents = (snap_entity *) realloc(snap->ents, count*sizeof(snap_entity));
+   }
+
+   if (tiles>snap->tile_room){
+      snap->tile_room = tiles;
+      snap->types = (char *) realloc(snap->types, tiles);
+      snap->tvalues = (int *) realloc(snap->tvalues, tiles*sizeof(int));
+   }
+
+   if (blocks>snap->block_room){
+      snap->block_room = blocks;
+      snap->pellets = (uint64_t *) realloc(snap->pellets, blocks*sizeof(uint64_t));
+   }
+
+   if ((count && snap->ents==NULL) || (tiles && (snap->types==NULL || snap->tvalues==NULL))
+      || (blocks && snap->pellets==NULL)){
+      printf("\nout of memory for snapshots\n");
+      exit(1);
+   }
+
+   return snap;
+}
+
+void publish_snapshot()
+{
+   snaps[snap_back].ready = true;
+   snap_back = __atomic_exchange_n(&snap_middle, snap_back|SNAP_FRESH, __ATOMIC_ACQ_REL) & ~SNAP_FRESH;
+}
+
+   /* a from b part of the way to c, or just c if it jumped */
+static int between(int b, int c, float part)
+{
+   if (abs(c-b)>16)
+      return c;   /* a death or a new level, not a move */
+
+   return b + (int)((c-b)*part);
+}
+
+void interpolate_snapshot(snapshot *snap, Uint64 now)
+{
+   float part = 1;
+
+      /* drawn up to a tick behind the simulation, which is what keeps motion
+         smooth between ticks at any frame rate */
+   if (snap->span && now < snap->published_at + snap->span)
+      part = (float)(now - snap->published_at) / snap->span;
+
+   for (int i=0; i<snap->count; i++){
+      snap->ents[i].draw_x = between(snap->ents[i].prev_x, snap->ents[i].x, part);
+      snap->ents[i].draw_y = between(snap->ents[i].prev_y, snap->ents[i].y, part);
+   }
+
+   snap->view_x = between(snap->player_prev_x, snap->player_x, part);
+   snap->view_y = between(snap->player_prev_y, snap->player_y, part);
+}
+
+snapshot *latest_snapshot()
+{
+   if (__atomic_load_n(&snap_middle, __ATOMIC_ACQUIRE) & SNAP_FRESH)
+      snap_front = __atomic_exchange_n(&snap_middle, snap_front, __ATOMIC_ACQ_REL) & ~SNAP_FRESH;
+
+   return &snaps[snap_front];
+}
@@ -0,0 +1,90 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "packman.h"
+#include "viewport.h"
+#include "pellets.h"
+
+/*
+ *  What the render thread gets to see of the game.
+ *
+ *  The simulation thread fills a snapshot after every tick and publishes it,
+ *  the render thread picks up the newest one when it starts a frame. There
+ *  are three, so each side always has one of its own and neither ever waits:
+ *  publishing and picking up are one atomic swap of a buffer index each.
+ *
+ *  Tiles are only copied for the area around the screen, the render thread
+ *  never touches the level itself while the simulation runs.
+ */
+
+   /* tiles copied around the screen, enough for the wall frames past VIEW_MARGIN */
+#define SNAP_MARGIN (VIEW_MARGIN+2)
+
+   /* microseconds a simulation tick stands for */
+#define TICK_USEC 20000
+
+struct snap_entity
+{
+   int x;
+   int y;
+   int prev_x;   /* before the last tick */
+   int prev_y;
+   int draw_x;   /* in between, see interpolate_snapshot */
+   int draw_y;
+   SDL_Surface *image;
+};
+
+struct snapshot
+{
+   bool ready;   /* false until the simulation first fills it this level */
+
+   unsigned int tick;   /* ticks simulated this level */
+   int packets;
+   int losses;
+   Uint32 died_at;   /* SDL_GetTicks of the last death, 0 for none yet */
+
+   int player_x;
+   int player_y;
+   int player_prev_x;
+   int player_prev_y;
+   int view_x;   /* where the camera goes, in between like draw_x */
+   int view_y;
+
+   Uint64 published_at;   /* usec_now when it was published */
+   unsigned int span;   /* usec the last publish moved things over, 0 for not moving */
+
+   int count;
+   snap_entity *ents;
+   int ent_room;
+
+   int x0, y0, x1, y1;   /* the tiles copied, [x0,x1) x [y0,y1) */
+   char *types;
+   int *tvalues;   /* same tiles, only filled in with renderpaths */
+   int tile_room;
+
+   int bx0, by0, bx1, by1;   /* the pellet blocks covering those tiles, see pellets.h */
+   uint64_t *pellets;
+   int block_room;
+};
+
+void reset_snapshots();   /* new level, only while the simulation is stopped */
+void free_snapshots();
+
+snapshot *begin_snapshot(int count, int tiles, int blocks);   /* simulation side: the one to fill, with room for this much */
+void publish_snapshot();   /* simulation side: hand it over */
+snapshot *latest_snapshot();   /* render side: the newest, stays put until the next call */
+
+   /* render side: set draw_x,draw_y and view_x,view_y to where things are at
+      usec now, part way from prev to where the simulation left them */
+void interpolate_snapshot(snapshot *snap, Uint64 now);
+
+   /* tile type in snap, '#' outside the copied tiles */
+static inline char snapshot_type(snapshot *snap, int x, int y)
+{
+   if (x<snap->x0 || x>=snap->x1 || y<snap->y0 || y>=snap->y1)
+      return '#';
+
+   return snap->types[(y-snap->y0)*(snap->x1-snap->x0) + (x-snap->x0)];
+}
+
+#endif
@@ -0,0 +1,422 @@
+/*
+ * Golden traces, run with 'Packman trace record <file>' and 'Packman trace check <file>'.
+ *
+ *   Plays every shipped level and two generated mazes for TRACE_TICKS ticks
+ *   each, the player steered by a seeded stream of key presses and taps sent
+ *   through the input queue, and writes a line a tick: the counters, a hash of
+ *   the path values (tvalue) around the player every TRACE_VALUES_EVERY ticks,
+ *   and every entity's position and direction. The values are only sampled
+ *   because working them out floods every entity over the whole level, and
+ *   doing that every tick makes a run about 18 times slower (the 128x128
+ *   maze alone is 40 floods of 16k tiles a tick). Nothing the game does
+ *   reads them back, so a change to how they are worked out shows up at the
+ *   next sample, and one to the positions still shows up on its own tick.
+ *
+ *   check plays the same and compares line for line with a file recorded
+ *   earlier, reporting the first tick each run differs on and what differed.
+ *   Record with the build you trust, usually the tree before an optimization
+ *   ('make golden'), then check the changed one in every tile layout
+ *   ('make trace'). Lookahead search is off, it is timed and so never plays
+ *   the same twice. The chunked layout is checked against a file of its own,
+ *   its floods stop at FLOOD_HORIZON so its ghosts really do play differently.
+ *
+ *   'Packman trace rewind' checks rewind.h against itself instead: it plays
+ *   the same runs, goes back REWIND_CHECK_BACK ticks every REWIND_CHECK_EVERY
+ *   and plays them again on the same keys, and every line has to come out as
+ *   it did the first time.
+ */
+
+#include <unistd.h>
+#include <string.h>
+
+#include "packman.h"
+#include "viewport.h"
+#include "levelgen.h"
+#include "input.h"
+#include "search.h"
+#include "assets.h"
+#include "rewind.h"
+
+   /* ticks played on each level */
+#define TRACE_TICKS 3000
+   /* how often the path values are worked out and hashed, see above */
+#define TRACE_VALUES_EVERY 25
+   /* how often trace rewind goes back, and how far */
+#define REWIND_CHECK_EVERY 250
+#define REWIND_CHECK_BACK 200
+
+static unsigned int trace_seed;
+
+static unsigned int trace_rand()
+{
+   /* xorshift32, like search.cpp */
+   unsigned int x = trace_seed;
+   x ^= x << 13;
+   x ^= x >> 17;
+   x ^= x << 5;
+   trace_seed = x;
+   return x;
+}
+
+   /* now and then let go of everything, press a key, sometimes just tap it */
+static void press_keys(int *wait)
+{
+   if (--*wait>0)
+      return;
+
+   *wait = 4 + trace_rand()%40;
+
+   int dir = 1 + trace_rand()%4;
+
+   if (trace_rand()%3==0)
+      for (int d=1; d<=4; d++)
+         if (input_held[d])
+            push_input(d, false);
+
+   push_input(dir, true);
+   if (trace_rand()%2==0)
+      push_input(dir, false);
+}
+
+   /* FNV-1a over the path values of the tiles around the player */
+static unsigned int hash_values()
+{
+   int cx, cy, x0, y0, x1, y1;
+   unsigned int hash = 2166136261u;
+
+   camera_for(player->x, player->y, &cx, &cy);
+   tiles_under(cx, cy, 0, &x0, &y0, &x1, &y1);
+   update_boardvalues(x0, y0, x1, y1);
+
+   for (int y=y0; y<y1; y++)
+      for (int x=x0; x<x1; x++)
+         if (tile_at(x,y).type!='#')
+            hash = (hash ^ (unsigned int)tile_at(x,y).tvalue) * 16777619u;
+
+   return hash;
+}
+
+   /* one tick as a line, into line */
+static void trace_line(char *line, size_t room, int tick, unsigned int values)
+{
+   int at = snprintf(line, room, "%d %d %d %d %08x", tick, packets, losses, has_won, values);
+
+   for (entity *ent=entity_list; ent!=NULL && at<(int)room; ent=ent->next)
+      at += snprintf(line+at, room-at, " %d,%d,%d", ent->x, ent->y, ent->direction);
+}
+
+   /* say what is different between a recorded line and ours */
+static void report(const char *name, const char *want, const char *got)
+{
+   static const char *fields[] = { "tick", "packets", "losses", "won", "path values" };
+   char *w = strdup(want), *g = strdup(got);
+   char *wsave, *gsave;
+   char *wt = strtok_r(w, " \n", &wsave);
+   char *gt = strtok_r(g, " \n", &gsave);
+
+   for (int i=0; wt!=NULL || gt!=NULL; i++)
+   {
+      if (wt==NULL || gt==NULL || strcmp(wt,gt)!=0){
+         if (i<5)
+            printf("%s: %s was %s, now %s\n", name, fields[i], wt ? wt : "-", gt ? gt : "-");
+         else
+            printf("%s: entity %d (x,y,direction) was %s, now %s\n", name, i-5, wt ? wt : "-", gt ? gt : "-");
+      }
+
+      wt = wt ? strtok_r(NULL, " \n", &wsave) : NULL;
+      gt = gt ? strtok_r(NULL, " \n", &gsave) : NULL;
+   }
+
+   free(w);
+   free(g);
+}
+
+   /* play one level, writing or checking its lines. returns 0 if it differed */
+static int trace_level(const char *name, char *lvl_file, unsigned int seed, FILE *out, FILE *golden)
+{
+   char *want = NULL;
+   size_t want_room = 0;
+   int same = 1;
+
+      /* the game keeps these over levels */
+   packets = 0;
+   losses = 0;
+   has_won = 0;
+
+   if (!load_lvl(lvl_file,(char *)"assets/walls_small.png",(char *)"assets/background.png") || player==NULL){
+      printf("%s: could not load %s\n", name, lvl_file);
+      return 0;
+   }
+
+   int count = 0;
+   for (entity *ent=entity_list; ent!=NULL; ent=ent->next)
+      count++;
+
+   size_t room = 64 + count*36;
+   char *line = (char *) malloc(room);
+
+   snprintf(line, room, "run %s %u", name, seed);
+   if (out!=NULL)
+      fprintf(out, "%s\n", line);
+   else if (getline(&want, &want_room, golden)==-1 || strncmp(want, line, strlen(line))!=0){
+      printf("%s: not in the golden file, or not next in it\n", name);
+      same = 0;
+   }
+
+   trace_seed = seed;
+   int wait = 1;
+
+   for (int tick=0; tick<TRACE_TICKS && same; tick++)
+   {
+      press_keys(&wait);
+      drain_input();
+      stream_chunks();
+      move_entities(1 + tick%3);
+
+      trace_line(line, room, tick, tick%TRACE_VALUES_EVERY==0 ? hash_values() : 0);
+
+      if (out!=NULL){
+         fprintf(out, "%s\n", line);
+         continue;
+      }
+
+      if (getline(&want, &want_room, golden)==-1){
+         printf("%s: golden file ends at tick %d\n", name, tick);
+         same = 0;
+         continue;
+      }
+
+      if (strncmp(want, line, strlen(line))!=0 || want[strlen(line)]!='\n'){
+         printf("%s: first difference at tick %d\n", name, tick);
+         report(name, want, line);
+         same = 0;
+      }
+   }
+
+      /* skip what is left of a run that differed */
+   if (golden!=NULL)
+      while (!same && getline(&want, &want_room, golden)!=-1 && strncmp(want, "end", 3)!=0)
+         ;
+   else
+      fprintf(out, "end\n");
+
+   if (golden!=NULL && same && (getline(&want, &want_room, golden)==-1 || strncmp(want, "end", 3)!=0)){
+      printf("%s: golden file goes on past tick %d\n", name, TRACE_TICKS);
+      same = 0;
+   }
+
+   if (golden!=NULL && same)
+      printf("%s: %d ticks the same\n", name, TRACE_TICKS);
+
+   free(line);
+   free(want);
+   cleanuplvl();
+
+   return same;
+}
+
+   /* where the keys were before a tick, to press them again after going back */
+struct key_state
+{
+   unsigned int seed;
+   int wait;
+   bool held[5];
+};
+
+   /* play one level going back now and then, returns 0 if a tick played again differed */
+static int rewind_level(const char *name, char *lvl_file, unsigned int seed)
+{
+   packets = 0;
+   losses = 0;
+   has_won = 0;
+
+   if (!load_lvl(lvl_file,(char *)"assets/walls_small.png",(char *)"assets/background.png") || player==NULL){
+      printf("%s: could not load %s\n", name, lvl_file);
+      return 0;
+   }
+
+   int count = 0;
+   for (entity *ent=entity_list; ent!=NULL; ent=ent->next)
+      count++;
+
+   size_t room = 64 + count*36;
+   char *lines = (char *) malloc(room*TRACE_TICKS);
+   char *line = (char *) malloc(room);
+   key_state *keys = (key_state *) malloc(TRACE_TICKS*sizeof(key_state));
+   int same = lines!=NULL && line!=NULL && keys!=NULL;
+   int rewinds = 0, replayed = 0;
+
+   trace_seed = seed;
+   int wait = 1;
+
+   for (int tick=0; tick<TRACE_TICKS && same; tick++)
+   {
+      keys[tick].seed = trace_seed;
+      keys[tick].wait = wait;
+      memcpy(keys[tick].held, input_held, sizeof(input_held));
+
+      press_keys(&wait);
+      drain_input();
+      stream_chunks();
+      move_entities(1 + tick%3);
+      rewind_record();
+
+      trace_line(lines + tick*room, room, tick, tick%TRACE_VALUES_EVERY==0 ? hash_values() : 0);
+
+      if (tick%REWIND_CHECK_EVERY!=REWIND_CHECK_EVERY-1)
+         continue;
+
+         /* back to before tick, then the same keys again */
+      int back = rewind_back(REWIND_CHECK_BACK);
+      int from = tick+1-back;
+
+      rewinds++;
+      trace_seed = keys[from].seed;
+      wait = keys[from].wait;
+      memcpy(input_held, keys[from].held, sizeof(input_held));
+
+      for (int t=from; t<=tick && same; t++)
+      {
+         press_keys(&wait);
+         drain_input();
+         stream_chunks();
+         move_entities(1 + t%3);
+         rewind_record();
+
+         trace_line(line, room, t, t%TRACE_VALUES_EVERY==0 ? hash_values() : 0);
+         replayed++;
+
+         if (strcmp(line, lines + t*room)!=0){
+            printf("%s: tick %d played differently after going back to tick %d\n", name, t, from);
+            report(name, lines + t*room, line);
+            same = 0;
+         }
+      }
+   }
+
+   if (same)
+      printf("%s: went back %d times, %d ticks played the same again\n", name, rewinds, replayed);
+
+   free(lines);
+   free(line);
+   free(keys);
+   cleanuplvl();
+
+   return same;
+}
+
+int run_rewind_check()
+{
+   char maze[] = "/tmp/packman_traceXXXXXX";
+   int fd;
+   int same = 1;
+
+   if ((fd = mkstemp(maze))==-1){
+      printf("\ncould not make a temporary level file\n");
+      return 1;
+   }
+   close(fd);
+
+   search_budget = 0;
+   printf("tile layout: %s\n", tile_layout_name());
+
+   for (int i=0; ; i++)
+   {
+      char lvl_file[32], name[32];
+
+      snprintf(lvl_file, 32, "levels/level%d", i);
+      if (access(data_path(lvl_file), R_OK)!=0)
+         break;
+
+      snprintf(name, 32, "level%d", i);
+      same &= rewind_level(name, lvl_file, 1000+i);
+   }
+
+   static const int mazes[] = { 64, 128 };
+
+   for (unsigned int i=0; i<sizeof(mazes)/sizeof(mazes[0]); i++)
+   {
+      int n = mazes[i];
+      char name[32];
+
+      snprintf(name, 32, "maze%dx%d", n, n);
+
+      if (!gen_maze_file(maze, n, n, 777+n, n*n/400)){
+         printf("%s: could not make it\n", name);
+         same = 0;
+         continue;
+      }
+      same &= rewind_level(name, maze, 2000+n);
+   }
+
+   unlink(maze);
+
+   printf(same ? "rewinding played the same\n" : "rewinding played DIFFERENTLY\n");
+
+   return same ? 0 : 1;
+}
+
+int run_trace(bool record, const char *path)
+{
+   FILE *file = fopen(path, record ? "w" : "r");
+   char maze[] = "/tmp/packman_traceXXXXXX";
+   int fd;
+   int same = 1;
+
+   if (file==NULL){
+      printf("\ncould not open %s\n", path);
+      return 1;
+   }
+
+   if ((fd = mkstemp(maze))==-1){
+      printf("\ncould not make a temporary level file\n");
+      fclose(file);
+      return 1;
+   }
+   close(fd);
+
+   search_budget = 0;
+   printf("tile layout: %s\n", tile_layout_name());
+
+   FILE *out = record ? file : NULL;
+   FILE *golden = record ? NULL : file;
+
+   for (int i=0; ; i++)
+   {
+      char lvl_file[32], name[32];
+
+      snprintf(lvl_file, 32, "levels/level%d", i);
+      if (access(data_path(lvl_file), R_OK)!=0)
+         break;
+
+      snprintf(name, 32, "level%d", i);
+      same &= trace_level(name, lvl_file, 1000+i, out, golden);
+   }
+
+   static const int mazes[] = { 64, 128 };
+
+   for (unsigned int i=0; i<sizeof(mazes)/sizeof(mazes[0]); i++)
+   {
+      int n = mazes[i];
+      char name[32];
+
+      snprintf(name, 32, "maze%dx%d", n, n);
+
+      if (!gen_maze_file(maze, n, n, 777+n, n*n/400)){
+         printf("%s: could not make it\n", name);
+         same = 0;
+         continue;
+      }
+      same &= trace_level(name, maze, 2000+n, out, golden);
+   }
+
+   unlink(maze);
+   fclose(file);
+
+   if (record)
+      printf("recorded %s\n", path);
+   else
+      printf(same ? "all the same as %s\n" : "DIFFERENT from %s\n", path);
+
+   return same ? 0 : 1;
+}
@@ -0,0 +1,424 @@
+/*
+ * Vectorized environments, see vecenv.h.
+ *
+ *   The shared mapping is a vecenv_control and then the arrays of vecenv_obs,
+ *   each on its own cache lines. vecenv_step sets every process pending,
+ *   bumps generation and wakes them all with one futex call; each process
+ *   plays its tick, writes its part of the arrays and counts pending down, the
+ *   last one wakes the caller. Both sides spin a little before sleeping,
+ *   since a tick is only a few microseconds. The caller sleeps at most
+ *   VECENV_POLL_MS at a time and looks for processes that died in between,
+ *   which would never count pending down. After one has, every call fails.
+ *
+ *   Tiles are written whole when a level starts and after that only the
+ *   pellets eaten since the step before, from the rewind eaten log.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <algorithm>
+
+#include "packman.h"
+#include "vecenv.h"
+#include "input.h"
+#include "search.h"
+#include "rewind.h"
+
+   /* checks of a flag before sleeping on it */
+#define VECENV_SPIN 4000
+   /* longest the caller sleeps before looking for dead processes */
+#define VECENV_POLL_MS 100
+
+#define VECENV_STEP 1
+#define VECENV_RESET 2
+#define VECENV_QUIT 3
+
+struct vecenv_control
+{
+   uint32_t generation;
+   uint32_t pending;
+   int32_t command;
+   int32_t failed;
+};
+
+struct vecenv
+{
+   vecenv_obs obs;
+   vecenv_control *control;
+
+   void *shared;
+   size_t shared_size;
+   pid_t *pids;   /* 0 once gone */
+   bool dead;   /* one of them died, nothing can be stepped any more */
+};
+
+static void futex_wait(uint32_t *addr, uint32_t val, const timespec *timeout)
+{
+   syscall(SYS_futex, addr, FUTEX_WAIT, val, timeout, NULL, 0);
+}
+
+static void futex_wake(uint32_t *addr, int count)
+{
+   syscall(SYS_futex, addr, FUTEX_WAKE, count, NULL, NULL, 0);
+}
+
+   /* wait for *addr to stop being val */
+static void wait_change(uint32_t *addr, uint32_t val)
+{
+   for (int spin=0; __atomic_load_n(addr, __ATOMIC_ACQUIRE)==val; spin++)
+      if (spin>=VECENV_SPIN)
+         futex_wait(addr, val, NULL);
+}
+
+static size_t cache_lines(size_t bytes)
+{
+   return (bytes+63) & ~(size_t)63;
+}
+
+/* in an environment's own process */
+
+static int env_index;
+static const char *env_level;
+static int eaten_seen;   /* of the eaten log, already in tiles */
+
+static void write_tiles(vecenv_obs *obs)
+{
+   unsigned char *tiles = obs->tiles + (size_t)env_index*obs->width*obs->height;
+   const int *eaten;
+   int count = rewind_eaten_log(&eaten);
+
+   if (eaten_seen<0){
+      for (int y=0; y<obs->height; y++)
+         for (int x=0; x<obs->width; x++)
+            tiles[y*obs->width + x] = (x<width && y<height) ? tile_at(x,y).type : '#';
+   }
+   else{
+      for (int i=eaten_seen; i<count; i++){
+         int x = eaten[i]%width, y = eaten[i]/width;
+         if (x<obs->width && y<obs->height)
+            tiles[y*obs->width + x] = tile_at(x,y).type;
+      }
+   }
+
+   eaten_seen = count;
+}
+
+static void write_entities(vecenv_obs *obs)
+{
+   int *ents = obs->entities + (size_t)env_index*obs->max_entities*4;
+   int i = 0;
+
+   for (entity *ent=entity_list; ent!=NULL && i<obs->max_entities; ent=ent->next, i++){
+      ents[i*4] = ent->x;
+      ents[i*4+1] = ent->y;
+      ents[i*4+2] = ent->type;
+      ents[i*4+3] = ent->direction;
+   }
+
+   memset(ents+i*4, 0, (obs->max_entities-i)*4*sizeof(int));
+}
+
+static bool start_level(vecenv_obs *obs)
+{
+   cleanuplvl();
+   packets = 0;
+   losses = 0;
+   has_won = 0;
+   reset_input();
+
+   if (!load_lvl((char *)env_level,(char *)"assets/walls_small.png",(char *)"assets/background.png") || player==NULL)
+      return false;
+
+   eaten_seen = -1;
+   write_tiles(obs);
+   write_entities(obs);
+   obs->ticks[env_index] = 0;
+
+   return true;
+}
+
+static void step(vecenv_obs *obs)
+{
+   int action = obs->actions[env_index];
+   int was_packets = packets;
+   int was_losses = losses;
+
+   memset(input_held, 0, sizeof(input_held));
+   next_turn = 0;
+   if (action>=1 && action<=4){
+      input_held[action] = true;
+      next_turn = action;
+   }
+
+   stream_chunks();
+   move_entities(1);
+   obs->ticks[env_index]++;
+
+   obs->rewards[env_index] = (was_packets-packets) - VECENV_DEATH_PENALTY*(losses-was_losses);
+   obs->dones[env_index] = packets<=0 || has_won || losses>=deaths_to_lose;
+
+   if (obs->dones[env_index])
+      start_level(obs);
+   else{
+      write_tiles(obs);
+      write_entities(obs);
+   }
+}
+
+static void finished(vecenv_control *control)
+{
+   if (__atomic_sub_fetch(&control->pending, 1, __ATOMIC_ACQ_REL)==0)
+      futex_wake(&control->pending, 1);
+}
+
+static void run_env(vecenv *env, pid_t parent)
+{
+   vecenv_obs *obs = &env->obs;
+   vecenv_control *control = env->control;
+
+      /* nobody left to step us */
+   prctl(PR_SET_PDEATHSIG, SIGKILL);
+   if (getppid()!=parent)
+      _exit(1);
+
+   setenv("SDL_VIDEODRIVER","dummy",1);
+   search_budget = 0;
+
+   if (!init() || !load_files() || !start_level(obs)){
+      printf("\nenvironment %d could not load %s\n", env_index, env_level);
+      __atomic_store_n(&control->failed, 1, __ATOMIC_RELEASE);
+      finished(control);
+      _exit(1);
+   }
+
+      /* the game's own messages, deaths and all, from every process would bury the caller's */
+   freopen("/dev/null", "w", stdout);
+   finished(control);
+
+   uint32_t seen = 0;
+
+   for (;;)
+   {
+      wait_change(&control->generation, seen);
+      seen = __atomic_load_n(&control->generation, __ATOMIC_ACQUIRE);
+
+      switch (control->command){
+         case VECENV_QUIT:
+            _exit(0);
+         case VECENV_RESET:
+            obs->rewards[env_index] = 0;
+            obs->dones[env_index] = 0;
+            if (!start_level(obs))
+               __atomic_store_n(&control->failed, 1, __ATOMIC_RELEASE);
+            break;
+         default:
+            step(obs);
+      }
+
+      finished(control);
+   }
+}
+
+/* the caller's side */
+
+   /* reap the processes that exited, returns whether any had */
+static bool reap_dead(vecenv *env)
+{
+   for (int i=0; i<env->obs.envs; i++)
+   {
+      int status;
+
+      if (env->pids[i]<=0 || waitpid(env->pids[i], &status, WNOHANG)!=env->pids[i])
+         continue;
+
+      if (WIFSIGNALED(status))
+         printf("\nenvironment %d died of signal %d\n", i, WTERMSIG(status));
+      else
+         printf("\nenvironment %d exited with %d\n", i, WEXITSTATUS(status));
+
+      env->pids[i] = 0;
+      env->dead = true;
+   }
+
+   return env->dead;
+}
+
+   /* until every process has counted pending down, 0 if one died first */
+static int wait_all(vecenv *env)
+{
+   vecenv_control *control = env->control;
+   timespec poll = { 0, VECENV_POLL_MS*1000000L };
+   uint32_t pending;
+
+   for (int spin=0; (pending = __atomic_load_n(&control->pending, __ATOMIC_ACQUIRE))!=0; spin++)
+   {
+      if (spin<VECENV_SPIN)
+         continue;
+
+      futex_wait(&control->pending, pending, &poll);
+
+      if (__atomic_load_n(&control->pending, __ATOMIC_ACQUIRE)!=0 && reap_dead(env)){
+         __atomic_store_n(&control->failed, 1, __ATOMIC_RELEASE);
+         return 0;
+      }
+   }
+
+   return 1;
+}
+
+   /* threads in this process */
+static int thread_count()
+{
+   DIR *dir = opendir("/proc/self/task");
+   struct dirent *d;
+   int count = 0;
+
+   if (dir==NULL)
+      return 1;
+
+   while ((d = readdir(dir))!=NULL)
+      if (d->d_name[0]!='.')
+         count++;
+
+   closedir(dir);
+   return count;
+}
+
+   /* every process does command, back when all are done */
+static int run_all(vecenv *env, int command)
+{
+   vecenv_control *control = env->control;
+
+   if (env->dead && command!=VECENV_QUIT)
+      return 0;
+
+   control->command = command;
+   __atomic_store_n(&control->pending, env->obs.envs, __ATOMIC_RELEASE);
+   __atomic_add_fetch(&control->generation, 1, __ATOMIC_ACQ_REL);
+   futex_wake(&control->generation, INT_MAX);
+
+   if (command==VECENV_QUIT)
+      return 1;
+
+   return wait_all(env) && !__atomic_load_n(&control->failed, __ATOMIC_ACQUIRE);
+}
+
+vecenv *vecenv_create(const char *const *levels, int envs, int w, int h, int max_entities)
+{
+   if (envs<=0 || w<=0 || h<=0 || max_entities<=0)
+      return NULL;
+
+   vecenv *env = (vecenv *) calloc(1, sizeof(vecenv));
+   size_t at = cache_lines(sizeof(vecenv_control));
+   size_t actions = at;        at += cache_lines(envs*sizeof(int));
+   size_t tiles = at;          at += cache_lines((size_t)envs*w*h);
+   size_t entities = at;       at += cache_lines((size_t)envs*max_entities*4*sizeof(int));
+   size_t rewards = at;        at += cache_lines(envs*sizeof(float));
+   size_t dones = at;          at += cache_lines(envs);
+   size_t ticks = at;          at += cache_lines(envs*sizeof(unsigned int));
+
+   if (env==NULL)
+      return NULL;
+
+   env->shared_size = at;
+   env->shared = mmap(NULL, at, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+   env->pids = (pid_t *) calloc(envs, sizeof(pid_t));
+
+   if (env->shared==MAP_FAILED || env->pids==NULL){
+      if (env->shared!=MAP_FAILED)
+         munmap(env->shared, at);
+      free(env->pids);
+      free(env);
+      return NULL;
+   }
+
+   char *base = (char *) env->shared;
+
+   env->control = (vecenv_control *) base;
+   env->obs.envs = envs;
+   env->obs.width = w;
+   env->obs.height = h;
+   env->obs.max_entities = max_entities;
+   env->obs.actions = (int *) (base+actions);
+   env->obs.tiles = (unsigned char *) (base+tiles);
+   env->obs.entities = (int *) (base+entities);
+   env->obs.rewards = (float *) (base+rewards);
+   env->obs.dones = (unsigned char *) (base+dones);
+   env->obs.ticks = (unsigned int *) (base+ticks);
+
+      /* the first loads count down pending like a step */
+   env->control->pending = envs;
+
+   pid_t parent = getpid();
+   int threads = thread_count();
+
+   if (threads>1)
+      printf("\nvecenv_create: forking a process with %d threads, see vecenv.h\n", threads);
+   fflush(stdout);
+
+   for (int i=0; i<envs; i++)
+   {
+      pid_t pid = fork();
+
+      if (pid==0){
+         env_index = i;
+         env_level = levels[i];
+         run_env(env, parent);
+      }
+
+      if (pid==-1){
+         printf("\ncould not start environment %d\n", i);
+         __atomic_store_n(&env->control->failed, 1, __ATOMIC_RELEASE);
+         __atomic_sub_fetch(&env->control->pending, envs-i, __ATOMIC_ACQ_REL);
+         break;
+      }
+
+      env->pids[i] = pid;
+   }
+
+   if (!wait_all(env) || env->control->failed){
+      vecenv_close(env);
+      return NULL;
+   }
+
+   return env;
+}
+
+const vecenv_obs *vecenv_observe(vecenv *env)
+{
+   return &env->obs;
+}
+
+int vecenv_step(vecenv *env, const int *actions)
+{
+   if (actions!=NULL)
+      memcpy(env->obs.actions, actions, env->obs.envs*sizeof(int));
+
+   return run_all(env, VECENV_STEP);
+}
+
+void vecenv_reset(vecenv *env)
+{
+   run_all(env, VECENV_RESET);
+}
+
+void vecenv_close(vecenv *env)
+{
+   run_all(env, VECENV_QUIT);
+
+   for (int i=0; i<env->obs.envs; i++)
+      if (env->pids[i]>0)
+         waitpid(env->pids[i], NULL, 0);
+
+   munmap(env->shared, env->shared_size);
+   free(env->pids);
+   free(env);
+}
@@ -0,0 +1,72 @@
+#ifndef VECENV_H
+#define VECENV_H
+
+/*
+ *  Many games at once, for training bots against the enemies. 'make env'
+ *  builds it as libpackman_env.so, callable from C or anything with a C FFI.
+ *
+ *  A game is all globals, so every environment is a process of its own,
+ *  forked by vecenv_create and stepped in parallel by vecenv_step. The
+ *  actions and observations live in one shared mapping the processes write
+ *  straight into; vecenv_create hands out pointers to it, meant to be
+ *  wrapped by the caller (as numpy arrays, say) rather than copied.
+ *
+ *  A step is one tick with the player holding the arrow in its action,
+ *  0 for none, 1 up 2 left 3 right 4 down. The reward is a point for every
+ *  pellet eaten less VECENV_DEATH_PENALTY for every death. When the level is
+ *  won or lost its done flag is set and the observation is already the level
+ *  started over. Tiles are the level's tile types, '#' past its edges.
+ *
+ *  Assets are loaded from the working directory, like the game, and
+ *  lookahead search is off so the same actions always play the same.
+ *
+ *  The processes are forked without an exec, so they start with a copy of
+ *  the caller's memory but only the thread that called vecenv_create. A lock
+ *  another thread held at that moment stays held in the copy for good. Call
+ *  vecenv_create before the host starts threads of its own (from Python,
+ *  before importing anything that starts a thread pool). It says so when
+ *  the process already has more than one thread, but goes ahead.
+ *
+ *  If a process dies, the vecenv_step waiting on it prints which one and
+ *  returns 0 within a tenth of a second, and so does every vecenv_step
+ *  after it. All that is left to do then is vecenv_close.
+ */
+
+#define VECENV_DEATH_PENALTY 10.0f
+
+   /* 'make env' hides everything else in the library */
+#define VECENV_API __attribute__((visibility("default")))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct vecenv_obs
+{
+   int envs;
+   int width;   /* tiles of every environment, levels smaller are padded */
+   int height;
+   int max_entities;
+
+   int *actions;   /* envs, filled in by the caller before vecenv_step(env, NULL) */
+   unsigned char *tiles;   /* envs*height*width tile types */
+   int *entities;   /* envs*max_entities of x, y, type, direction; type 0 past the last */
+   float *rewards;   /* envs, of the last step */
+   unsigned char *dones;   /* envs, of the last step */
+   unsigned int *ticks;   /* envs, ticks since the level last started */
+};
+
+typedef struct vecenv vecenv;
+
+   /* one environment for every level file, NULL if any of them would not load */
+VECENV_API vecenv *vecenv_create(const char *const *levels, int envs, int width, int height, int max_entities);
+VECENV_API const struct vecenv_obs *vecenv_observe(vecenv *env);   /* the pointers, good until vecenv_close */
+VECENV_API int vecenv_step(vecenv *env, const int *actions);   /* actions may be NULL to use obs->actions, returns 1 on success */
+VECENV_API void vecenv_reset(vecenv *env);   /* every level started over */
+VECENV_API void vecenv_close(vecenv *env);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,155 @@
+/*
+ * The camera, and the background it looks at.
+ *
+ *   Walls used to be blitted into one background surface for the whole
+ *   level, which capped levels at the window size and made loading cost
+ *   grow with the map. Now only the tiles under the screen, plus
+ *   VIEW_MARGIN on every side, are baked into a surface a bit bigger than
+ *   the screen. It is rebaked when the camera gets out of it, so drawing
+ *   costs the same whatever the size of the level.
+ *
+ *   The view belongs to the render thread, so walls come from the tiles in
+ *   a snapshot rather than the level.
+ */
+
+#include "viewport.h"
+#include "snapshot.h"
+
+int camera_x = 0;
+int camera_y = 0;
+
+   /* the background image and the wall sprite sheet for the level */
+SDL_Surface *backdrop = NULL;
+SDL_Surface *walltiles = NULL;
+
+   /* backdrop + walls for the tiles around the camera */
+SDL_Surface *baked = NULL;
+   /* world pixel of baked's top left corner */
+int baked_x = 0;
+int baked_y = 0;
+bool baked_valid = false;
+
+#define BAKED_WIDTH (SCREEN_WIDTH + 2*16*VIEW_MARGIN)
+#define BAKED_HEIGHT (SCREEN_HEIGHT + 2*16*VIEW_MARGIN)
+
+void reset_view(SDL_Surface *new_backdrop, SDL_Surface *new_walltiles)
+{
+   free_view();
+
+   backdrop = new_backdrop;
+   walltiles = new_walltiles;
+
+   baked = SDL_CreateRGBSurface( SDL_SWSURFACE, BAKED_WIDTH, BAKED_HEIGHT, SCREEN_BPP,
+      screen->format->Rmask, screen->format->Gmask, screen->format->Bmask, 0 );
+
+   camera_x = camera_y = 0;
+   baked_valid = false;
+}
+
+void free_view()
+{
+   SDL_FreeSurface(backdrop);
+   SDL_FreeSurface(walltiles);
+   SDL_FreeSurface(baked);
+
+   backdrop = walltiles = baked = NULL;
+   baked_valid = false;
+}
+
+void camera_for(int x, int y, int *cx, int *cy)
+{
+   *cx = x + 8 - SCREEN_WIDTH/2;
+   *cy = y + 8 - SCREEN_HEIGHT/2;
+
+      /* keep the level on screen, and levels smaller than it at the top left */
+   *cx = std::max(std::min(*cx, width*16-SCREEN_WIDTH), 0);
+   *cy = std::max(std::min(*cy, height*16-SCREEN_HEIGHT), 0);
+}
+
+void tiles_under(int cx, int cy, int margin, int *x0, int *y0, int *x1, int *y1)
+{
+   *x0 = std::max(cx/16 - margin, 0);
+   *y0 = std::max(cy/16 - margin, 0);
+   *x1 = std::min((cx+SCREEN_WIDTH)/16 + 1 + margin, width);
+   *y1 = std::min((cy+SCREEN_HEIGHT)/16 + 1 + margin, height);
+}
+
+void visible_tiles(int *x0, int *y0, int *x1, int *y1)
+{
+   tiles_under(camera_x, camera_y, VIEW_MARGIN, x0, y0, x1, y1);
+}
+
+   /* For rendering walls, Tile frames are the sum of it's walled neighbors */
+static int wall_frame(snapshot *snap, int x, int y)
+{
+   return (y-1>=0 && snapshot_type(snap,x,y-1) == '#')
+      +2*(x-1>=0 && snapshot_type(snap,x-1,y) == '#' )
+      +4*(x+1<width && snapshot_type(snap,x+1,y) == '#')
+      +8*(y+1<height && snapshot_type(snap,x,y+1) == '#');
+}
+
+   /* bake the backdrop and walls for the area whose top left is world pixel bx,by */
+static void bake(snapshot *snap, int bx, int by)
+{
+   baked_x = bx;
+   baked_y = by;
+
+      /* the backdrop is tiled over the world, so it scrolls with the walls */
+   int start_x = bx - ((bx%backdrop->w)+backdrop->w)%backdrop->w;
+   int start_y = by - ((by%backdrop->h)+backdrop->h)%backdrop->h;
+
+   for (int y=start_y; y<by+BAKED_HEIGHT; y+=backdrop->h)
+      for (int x=start_x; x<bx+BAKED_WIDTH; x+=backdrop->w)
+         apply_surface(x-bx, y-by, backdrop, baked);
+
+   SDL_Rect clip;
+   clip.w=16;
+   clip.h=16;
+
+   int x0 = std::max(bx/16, 0);
+   int y0 = std::max(by/16, 0);
+   int x1 = std::min((bx+BAKED_WIDTH)/16 + 1, width);
+   int y1 = std::min((by+BAKED_HEIGHT)/16 + 1, height);
+
+   for (int y=y0; y<y1; y++)
+   {
+      for (int x=x0; x<x1; x++)
+      {
+         if (snapshot_type(snap,x,y) != '#')
+            continue;
+
+         int frame = wall_frame(snap,x,y);
+
+         clip.x = 16*(frame%4);
+         clip.y = 16*(frame/4);
+
+         apply_surface(x*16-bx, y*16-by, walltiles, baked, &clip);
+      }
+   }
+
+   baked_valid = true;
+}
+
+void update_camera(snapshot *snap)
+{
+   camera_for(snap->view_x, snap->view_y, &camera_x, &camera_y);
+
+   if (!baked_valid || camera_x<baked_x || camera_y<baked_y
+      || camera_x+SCREEN_WIDTH>baked_x+BAKED_WIDTH || camera_y+SCREEN_HEIGHT>baked_y+BAKED_HEIGHT)
+   {
+         /* center the new bake on the camera, on a tile boundary */
+      bake(snap, 16*((camera_x - 16*VIEW_MARGIN)/16), 16*((camera_y - 16*VIEW_MARGIN)/16));
+   }
+}
+
+void draw_background(SDL_Surface *dest)
+{
+   SDL_Rect clip;
+
+   clip.x = camera_x - baked_x;
+   clip.y = camera_y - baked_y;
+   clip.w = SCREEN_WIDTH;
+   clip.h = SCREEN_HEIGHT;
+
+   apply_surface(0, 0, baked, dest, &clip);
+}
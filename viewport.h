@@ -0,0 +1,35 @@
+#ifndef VIEWPORT_H
+#define VIEWPORT_H
+
+#include "packman.h"
+
+   /* tiles past the edge of the screen that still get baked and drawn */
+#define VIEW_MARGIN 2
+
+   /* world pixel at the top left corner of the screen */
+extern int camera_x;
+extern int camera_y;
+
+   /* start viewing a new level, takes ownership of both surfaces */
+void reset_view(SDL_Surface *backdrop, SDL_Surface *walltiles);
+void free_view();
+
+struct snapshot;
+
+   /* the camera for a player at world pixel x,y, kept on the level */
+void camera_for(int x, int y, int *cx, int *cy);
+
+   /* tiles [x0,x1) x [y0,y1) under a screen at camera cx,cy plus margin, clamped to the level */
+void tiles_under(int cx, int cy, int margin, int *x0, int *y0, int *x1, int *y1);
+
+   /* center the camera on snap's player where it is drawn, rebaking the background from snap's
+      tiles if it left the baked area */
+void update_camera(snapshot *snap);
+
+   /* tiles [x0,x1) x [y0,y1) on screen plus VIEW_MARGIN, clamped to the level */
+void visible_tiles(int *x0, int *y0, int *x1, int *y1);
+
+   /* blit the baked backdrop and walls under the camera */
+void draw_background(SDL_Surface *dest);
+
+#endif